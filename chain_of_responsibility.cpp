@@ -20,20 +20,194 @@
     when client send request then this request will go first with obj1. if obj1 will not able to fulfill the request then it will forward to second 
     obj2 and so no untill fullfil the request. if request is not able to fullfil then system should send some error message(not able to fullfil request).
     
+    Async mode:-
+    
+    ---> AsyncLogProcessor sits in front of the chain. Callers only push (level, message) into a bounded lock-free ring buffer.
+    ---> A background writer thread drains the buffer in batches, lets the Info/Debug/Error processors format every record
+         into one buffer and writes that buffer to the sink with a single write + flush per batch.
+    ---> When the buffer is full the OverflowPolicy decides: Block (wait for space), DropOldest, DropNewest.
+    
+    Dispatch table:-
+    
+    ---> LogDispatchTable walks a built chain once and stores, per level, the first processor handling it.
+         A record then goes straight to its processor (one virtual call) instead of hopping through the chain.
+    ---> run "./a.out bench" to compare the chain walk and the table for 3, 16 and 64 processors.
+    
+    Structured logging:-
+    
+    ---> log() takes a string_view, so passing a literal never allocates.
+    ---> logf<Level>("user {} failed {} times", name, count) packs the arguments by value/view and the
+         processor that accepts the level formats them into a stack buffer. Filtered levels never format.
+    ---> levels below LOG_MIN_LEVEL (-DLOG_MIN_LEVEL=3) compile to nothing in logf() and are dropped by log().
+    ---> build with -DLOG_COUNT_ALLOCATIONS=1 and run "./a.out alloc" to check that log calls do not allocate.
+    
+    Binary logging:-
+    
+    ---> BinaryLogSink stores records of chosen levels as (timestamp, level, format-id, packed arguments)
+         in pre-allocated memory-mapped files that rotate when full, and forwards every other level.
+    ---> "./a.out decode file.clog" prints such files exactly like the Info/Debug/Error processors would.
+    ---> run "./a.out binlog" for a round trip and bytes/record against the text output.
+    
+    Per-thread buffers:-
+    
+    ---> ThreadBufferedLogProcessor gives every logging thread its own buffer with its own sequence numbers,
+         so threads never share a lock or the stream while logging.
+    ---> a merger thread writes the records of all threads ordered by timestamp.
+    ---> run "./a.out stress" to log from 8..64 threads and check the merged order.
+    
+    compile:- g++ -std=c++17 -O2 -pthread chain_of_responsibility.cpp
+    
 */
 
 
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <initializer_list>
+#include <queue>
+#include <deque>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
+// Minimum level compiled in, logf<Level>() below it compiles to nothing and log() drops it
+// e.g. g++ -DLOG_MIN_LEVEL=3 ... keeps only ERROR
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// Replace the global operator new with a counting one for the allocation check ("./a.out alloc")
+// Off by default so the logger itself does not pay for it, e.g. g++ -DLOG_COUNT_ALLOCATIONS=1 ...
+#ifndef LOG_COUNT_ALLOCATIONS
+#define LOG_COUNT_ALLOCATIONS 0
+#endif
+
+// One format argument, stored by value or as a view so packing arguments never allocates
+struct LogArg
+{
+    enum Type { SIGNED, UNSIGNED, FLOATING, TEXT, CHAR, BOOL };
+
+    Type type;
+    union
+    {
+        long long signedValue;
+        unsigned long long unsignedValue;
+        double floatingValue;
+        char charValue;
+        bool boolValue;
+    };
+    string_view text;
+
+    // Constructors, one per supported argument type
+    LogArg(int value) : type(SIGNED), signedValue(value) {}
+    LogArg(long value) : type(SIGNED), signedValue(value) {}
+    LogArg(long long value) : type(SIGNED), signedValue(value) {}
+    LogArg(unsigned int value) : type(UNSIGNED), unsignedValue(value) {}
+    LogArg(unsigned long value) : type(UNSIGNED), unsignedValue(value) {}
+    LogArg(unsigned long long value) : type(UNSIGNED), unsignedValue(value) {}
+    LogArg(double value) : type(FLOATING), floatingValue(value) {}
+    LogArg(char value) : type(CHAR), charValue(value) {}
+    LogArg(bool value) : type(BOOL), boolValue(value) {}
+    LogArg(const char* value) : type(TEXT), signedValue(0), text(value) {}
+    LogArg(string_view value) : type(TEXT), signedValue(0), text(value) {}
+    LogArg(const string& value) : type(TEXT), signedValue(0), text(value) {}
+};
+
+// Fixed-size buffer a record is formatted into, long messages are truncated
+class LogLineBuffer
+{
+    char data[256];
+    size_t length;
+
+    public:
+
+    // Constructor
+    LogLineBuffer() : length(0) {}
+
+    // Append text, dropping whatever does not fit
+    void append(string_view text)
+    {
+        size_t n = min(text.size(), sizeof(data) - length);
+        memcpy(data + length, text.data(), n);
+        length += n;
+    }
+
+    // Append one argument
+    void appendArg(const LogArg& arg)
+    {
+        char number[32];
+        int n = 0;
+        switch (arg.type)
+        {
+            case LogArg::SIGNED:   n = snprintf(number, sizeof(number), "%lld", arg.signedValue); break;
+            case LogArg::UNSIGNED: n = snprintf(number, sizeof(number), "%llu", arg.unsignedValue); break;
+            case LogArg::FLOATING: n = snprintf(number, sizeof(number), "%g", arg.floatingValue); break;
+            case LogArg::CHAR:     number[0] = arg.charValue; n = 1; break;
+            case LogArg::BOOL:     append(arg.boolValue ? "true" : "false"); return;
+            case LogArg::TEXT:     append(arg.text); return;
+        }
+        append(string_view(number, n));
+    }
+
+    // Replace every "{}" in fmt with the next argument
+    void format(string_view fmt, const LogArg* args, size_t argCount)
+    {
+        size_t next = 0;
+        size_t start = 0;
+        for (size_t i = 0; i + 1 < fmt.size(); ++i)
+        {
+            if (fmt[i] == '{' && fmt[i + 1] == '}' && next < argCount)
+            {
+                append(fmt.substr(start, i - start));
+                appendArg(args[next++]);
+                start = i + 2;
+                ++i;
+            }
+        }
+        append(fmt.substr(start));
+    }
+
+    // View of the formatted text
+    string_view view() const
+    {
+        return string_view(data, length);
+    }
+};
+
 class LogProcessor 
 {
     public:
 
     // Static constants representing log levels
-    static const int INFO;
-    static const int DEBUG;
-    static const int ERROR;
+    static constexpr int INFO = 1;
+    static constexpr int DEBUG = 2;
+    static constexpr int ERROR = 3;
     
     // Pointer to the next logger processor
     LogProcessor* nextLoggerProcessor;
@@ -41,21 +215,83 @@ class LogProcessor
     // Constructor
     LogProcessor(LogProcessor* loggerProcessor):nextLoggerProcessor(loggerProcessor){}
 
+    // Virtual destructor, every processor owns the rest of the chain
+    virtual ~LogProcessor()
+    {
+        delete nextLoggerProcessor;
+    }
+
+    // True for levels below LOG_MIN_LEVEL, always false (and folded away) when LOG_MIN_LEVEL is 0
+    static constexpr bool belowMinLevel(int logLevel)
+    {
+        return LOG_MIN_LEVEL > 0 && logLevel < LOG_MIN_LEVEL;
+    }
+
     // Virtual method for logging
-    virtual void log(int logLevel, string message)
+    virtual void log(int logLevel, string_view message)
     {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
         // If there's a next logger processor, delegate the logging to it
         if(nextLoggerProcessor != nullptr) 
         {
             nextLoggerProcessor->log(logLevel, message);
         }
     }
-};
 
-// Definition of static constants
-const int LogProcessor::INFO = 1;
-const int LogProcessor::DEBUG = 2;
-const int LogProcessor::ERROR = 3;
+    // Level handled by this processor, -1 if it only forwards
+    virtual int getLevel() const
+    {
+        return -1;
+    }
+
+    // Write a record of the handled level, without forwarding (used by the dispatch table)
+    virtual void handle(int, string_view)
+    {
+    }
+
+    // Virtual method for logging with format arguments
+    // The message is only formatted (into a stack buffer) once a processor accepts the level
+    virtual void logFormatted(int logLevel, string_view fmt, const LogArg* args, size_t argCount)
+    {
+        if (logLevel >= 0 && logLevel == getLevel())
+        {
+            LogLineBuffer line;
+            line.format(fmt, args, argCount);
+            handle(logLevel, line.view());
+        }
+        else if(nextLoggerProcessor != nullptr)
+        {
+            nextLoggerProcessor->logFormatted(logLevel, fmt, args, argCount);
+        }
+    }
+
+    // Structured logging entry point, e.g. logf<LogProcessor::ERROR>("user {} failed {} times", name, count)
+    // Levels below LOG_MIN_LEVEL compile to nothing
+    template<int Level, typename... Args>
+    void logf(string_view fmt, const Args&... args)
+    {
+        if constexpr (Level >= LOG_MIN_LEVEL)
+        {
+            const LogArg packed[sizeof...(Args) + 1] = { LogArg(args)..., LogArg(0) };
+            logFormatted(Level, fmt, packed, sizeof...(Args));
+        }
+    }
+
+    // Virtual method for formatting a record into a buffer instead of writing it (used by the async writer)
+    // Returns false if no processor in the chain handles the level
+    virtual bool format(int logLevel, string_view message, string& out)
+    {
+        if(nextLoggerProcessor != nullptr)
+        {
+            return nextLoggerProcessor->format(logLevel, message, out);
+        }
+        return false;
+    }
+};
 
 // Derived class for logging INFO level messages
 class InfoLogProcessor : public LogProcessor
@@ -65,12 +301,29 @@ class InfoLogProcessor : public LogProcessor
     // Constructor
     InfoLogProcessor(LogProcessor* nextLoggerProcessor) : LogProcessor(nextLoggerProcessor){}
 
+    // Level handled by this processor
+    int getLevel() const override
+    {
+        return INFO;
+    }
+
+    // Write an INFO record
+    void handle(int, string_view message) override
+    {
+        cout<<"INFO: "<<message<<endl;
+    }
+
     // Overridden log method for INFO level messages
-    void log(int logLevel, string message) override
+    void log(int logLevel, string_view message) override
     {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
         if (logLevel == INFO)
         {
-            cout<<"INFO: "<<message<<endl;
+            handle(logLevel, message);
         } 
         else 
         {
@@ -78,6 +331,17 @@ class InfoLogProcessor : public LogProcessor
             LogProcessor::log(logLevel, message);
         }
     }
+
+    // Overridden format method for INFO level messages
+    bool format(int logLevel, string_view message, string& out) override
+    {
+        if (logLevel == INFO)
+        {
+            out.append("INFO: ").append(message).push_back('\n');
+            return true;
+        }
+        return LogProcessor::format(logLevel, message, out);
+    }
 };
 
 // Derived class for logging ERROR level messages
@@ -87,12 +351,29 @@ public:
     // Constructor
     ErrorLogProcessor(LogProcessor* nextLoggerProcessor) : LogProcessor(nextLoggerProcessor){}
 
+    // Level handled by this processor
+    int getLevel() const override
+    {
+        return ERROR;
+    }
+
+    // Write an ERROR record
+    void handle(int, string_view message) override
+    {
+        cout<<"ERROR: "<<message<<endl;
+    }
+
     // Overridden log method for ERROR level messages
-    void log(int logLevel, string message) override 
+    void log(int logLevel, string_view message) override 
     {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
         if (logLevel == ERROR)
         {
-            cout<<"ERROR: "<< message<<endl;
+            handle(logLevel, message);
         } 
         else
         {
@@ -100,6 +381,17 @@ public:
             LogProcessor::log(logLevel, message);
         }
     }
+
+    // Overridden format method for ERROR level messages
+    bool format(int logLevel, string_view message, string& out) override
+    {
+        if (logLevel == ERROR)
+        {
+            out.append("ERROR: ").append(message).push_back('\n');
+            return true;
+        }
+        return LogProcessor::format(logLevel, message, out);
+    }
 };
 
 // Derived class for logging DEBUG level messages
@@ -109,12 +401,29 @@ public:
     // Constructor
     DebugLogProcessor(LogProcessor* nextLoggerProcessor) : LogProcessor(nextLoggerProcessor) {}
 
+    // Level handled by this processor
+    int getLevel() const override
+    {
+        return DEBUG;
+    }
+
+    // Write a DEBUG record
+    void handle(int, string_view message) override
+    {
+        cout<<"DEBUG: "<<message<<endl;
+    }
+
     // Overridden log method for DEBUG level messages
-    void log(int logLevel, string message) override
+    void log(int logLevel, string_view message) override
     {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
         if (logLevel == DEBUG)
         {
-            cout<<"DEBUG: "<<message<<endl;
+            handle(logLevel, message);
         } 
         else 
         {
@@ -122,22 +431,1644 @@ public:
             LogProcessor::log(logLevel, message);
         }
     }
+
+    // Overridden format method for DEBUG level messages
+    bool format(int logLevel, string_view message, string& out) override
+    {
+        if (logLevel == DEBUG)
+        {
+            out.append("DEBUG: ").append(message).push_back('\n');
+            return true;
+        }
+        return LogProcessor::format(logLevel, message, out);
+    }
 };
 
-int main()
+// Processor for a user-added level (e.g. WARN = 4), prints "<label>: message"
+class CustomLogProcessor : public LogProcessor
 {
-    // Creating an instance of the log chain with INFO -> DEBUG -> ERROR order
-    LogProcessor* logObject = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr)));
-    
-    // Logging different messages with different log levels
-    logObject->log(LogProcessor::ERROR, "exception happens");
-    
-    logObject->log(LogProcessor::DEBUG, "need to debug this");
-    
-    logObject->log(LogProcessor::INFO, "just for information");
-    
-    // Clean up dynamic memory
-    delete logObject;
+    int level;
+    string label;
+
+    public:
+
+    // Constructor
+    CustomLogProcessor(int level, const string& label, LogProcessor* nextLoggerProcessor)
+        : LogProcessor(nextLoggerProcessor), level(level), label(label) {}
+
+    // Level handled by this processor
+    int getLevel() const override
+    {
+        return level;
+    }
+
+    // Write a record of the custom level
+    void handle(int, string_view message) override
+    {
+        cout<<label<<": "<<message<<endl;
+    }
+
+    // Overridden log method for the custom level
+    void log(int logLevel, string_view message) override
+    {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
+        if (logLevel == level)
+        {
+            handle(logLevel, message);
+        }
+        else
+        {
+            LogProcessor::log(logLevel, message);
+        }
+    }
+
+    // Overridden format method for the custom level
+    bool format(int logLevel, string_view message, string& out) override
+    {
+        if (logLevel == level)
+        {
+            out.append(label).append(": ").append(message).push_back('\n');
+            return true;
+        }
+        return LogProcessor::format(logLevel, message, out);
+    }
+};
+
+// Chain "compiled" into a table indexed by level
+// The chain is still built the usual way; the table is built once from it and a record
+// then reaches its processor with a single indirect call instead of walking every hop.
+// The first processor in the chain that handles a level wins, same as the linear walk.
+// Levels up to DENSE_LEVELS are indexed directly, larger (sparse) ones are binary searched.
+// The table does not own the chain.
+class LogDispatchTable
+{
+    static constexpr int DENSE_LEVELS = 256;
+
+    vector<LogProcessor*> handlers;
+    vector<pair<int, LogProcessor*>> sparseHandlers;
+
+    public:
+
+    // Constructor, walks the chain once
+    LogDispatchTable(LogProcessor* chain)
+    {
+        for (LogProcessor* processor = chain; processor != nullptr; processor = processor->nextLoggerProcessor)
+        {
+            int level = processor->getLevel();
+            if (level < 0 || LogProcessor::belowMinLevel(level))
+            {
+                continue;
+            }
+            if (level >= DENSE_LEVELS)
+            {
+                auto it = lower_bound(sparseHandlers.begin(), sparseHandlers.end(), make_pair(level, (LogProcessor*)nullptr));
+                if (it == sparseHandlers.end() || it->first != level)
+                {
+                    sparseHandlers.insert(it, make_pair(level, processor));
+                }
+                continue;
+            }
+            if ((size_t)level >= handlers.size())
+            {
+                handlers.resize(level + 1, nullptr);
+            }
+            if (handlers[level] == nullptr)
+            {
+                handlers[level] = processor;
+            }
+        }
+    }
+
+    // Log a record, levels nobody handles are ignored like in the chain
+    void log(int logLevel, string_view message) const
+    {
+        if ((size_t)logLevel < handlers.size())
+        {
+            if (handlers[logLevel] != nullptr)
+            {
+                handlers[logLevel]->handle(logLevel, message);
+            }
+        }
+        else if (logLevel >= DENSE_LEVELS)
+        {
+            auto it = lower_bound(sparseHandlers.begin(), sparseHandlers.end(), make_pair(logLevel, (LogProcessor*)nullptr));
+            if (it != sparseHandlers.end() && it->first == logLevel)
+            {
+                it->second->handle(logLevel, message);
+            }
+        }
+    }
+};
+
+// ******************************* Async (batched) logging *******************************
+
+// What to do with a new record when the ring buffer is full
+enum class OverflowPolicy
+{
+    Block,          // caller waits until the writer frees a slot
+    DropOldest,     // oldest queued record is discarded to make room
+    DropNewest      // new record is discarded
+};
+
+// Bounded lock-free ring buffer (Dmitry Vyukov's sequence-per-cell queue)
+// Many threads push, the writer thread pops. Pop is also safe from producers,
+// which is what DropOldest relies on.
+class LogRingBuffer
+{
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        int logLevel;
+        string message;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // Producer and consumer positions live on separate cache lines
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+
+    public:
+
+    // Constructor, capacity is rounded up to a power of two
+    LogRingBuffer(size_t capacity) : enqueuePos(0), dequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    // Try to push a record, returns false if the buffer is full
+    bool tryPush(int logLevel, string_view message)
+    {
+        Cell* cell;
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+
+        // assign() reuses the capacity the cell already has, so no allocation once warmed up
+        cell->logLevel = logLevel;
+        cell->message.assign(message);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    // Try to pop a record, returns false if the buffer is empty
+    // The message is swapped out so buffers keep circulating between caller and cell
+    bool tryPop(int& logLevel, string& message)
+    {
+        Cell* cell;
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+
+        logLevel = cell->logLevel;
+        message.swap(cell->message);
+        cell->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+};
+
+// Head of the chain that moves formatting and output to a background writer thread
+// The wrapped Info/Debug/Error processors still decide how each record is formatted
+class AsyncLogProcessor : public LogProcessor
+{
+    LogRingBuffer queue;
+    OverflowPolicy policy;
+    ostream& sink;
+    size_t maxBatch;
+
+    // Counters
+    atomic<unsigned long long> enqueued;
+    atomic<unsigned long long> dropped;
+    atomic<unsigned long long> written;
+    atomic<unsigned long long> droppedOldest;
+
+    // Writer thread and its wake-up signal
+    atomic<bool> stopping;
+    atomic<bool> writerIdle;
+    mutex wakeMutex;
+    condition_variable wakeCondition;
+    thread writer;
+
+    // Drain the queue in batches until stopped
+    void writerLoop()
+    {
+        string batch;
+        string message;
+        int logLevel;
+
+        for (;;)
+        {
+            size_t count = 0;
+            batch.clear();
+            while (count < maxBatch && queue.tryPop(logLevel, message))
+            {
+                LogProcessor::format(logLevel, message, batch);
+                ++count;
+            }
+
+            if (count > 0)
+            {
+                // one buffered write per batch
+                sink.write(batch.data(), batch.size());
+                sink.flush();
+                written.fetch_add(count, memory_order_release);
+                continue;
+            }
+
+            if (stopping.load(memory_order_acquire))
+            {
+                break;
+            }
+
+            // Nothing to do, sleep until a producer wakes us (the timeout covers a missed wake-up)
+            unique_lock<mutex> lock(wakeMutex);
+            writerIdle.store(true, memory_order_seq_cst);
+            wakeCondition.wait_for(lock, chrono::milliseconds(1));
+            writerIdle.store(false, memory_order_relaxed);
+        }
+    }
+
+    // Wake the writer if it is sleeping
+    void wakeWriter()
+    {
+        if (writerIdle.load(memory_order_seq_cst))
+        {
+            wakeCondition.notify_one();
+        }
+    }
+
+    public:
+
+    // Constructor
+    AsyncLogProcessor(LogProcessor* nextLoggerProcessor, size_t capacity = 4096,
+                      OverflowPolicy policy = OverflowPolicy::Block, ostream& sink = cout, size_t maxBatch = 256)
+        : LogProcessor(nextLoggerProcessor), queue(capacity), policy(policy), sink(sink), maxBatch(maxBatch),
+          enqueued(0), dropped(0), written(0), droppedOldest(0), stopping(false), writerIdle(false)
+    {
+        writer = thread(&AsyncLogProcessor::writerLoop, this);
+    }
+
+    // Destructor drains whatever is still queued before the chain is deleted
+    ~AsyncLogProcessor() override
+    {
+        stopping.store(true, memory_order_release);
+        wakeCondition.notify_one();
+        writer.join();
+    }
+
+    // Overridden log method, only enqueues the record
+    void log(int logLevel, string_view message) override
+    {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
+        while (!queue.tryPush(logLevel, message))
+        {
+            if (policy == OverflowPolicy::DropNewest)
+            {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+
+            if (policy == OverflowPolicy::DropOldest)
+            {
+                int oldLevel;
+                string oldMessage;
+                if (queue.tryPop(oldLevel, oldMessage))
+                {
+                    dropped.fetch_add(1, memory_order_relaxed);
+                    droppedOldest.fetch_add(1, memory_order_release);
+                }
+            }
+            else
+            {
+                // Block: let the writer make room
+                wakeWriter();
+                this_thread::yield();
+            }
+        }
+
+        enqueued.fetch_add(1, memory_order_release);
+        wakeWriter();
+    }
+
+    // Overridden formatted log method, formats on the caller's stack and enqueues the text
+    void logFormatted(int logLevel, string_view fmt, const LogArg* args, size_t argCount) override
+    {
+        LogLineBuffer line;
+        line.format(fmt, args, argCount);
+        log(logLevel, line.view());
+    }
+
+    // Wait until every accepted record has been written (or dropped as oldest)
+    void flush()
+    {
+        while (written.load(memory_order_acquire) + droppedOldest.load(memory_order_acquire) <
+               enqueued.load(memory_order_acquire))
+        {
+            wakeWriter();
+            this_thread::yield();
+        }
+    }
+
+    // Number of records accepted into the queue
+    unsigned long long getEnqueuedCount() const
+    {
+        return enqueued.load(memory_order_relaxed);
+    }
+
+    // Number of records discarded by DropOldest/DropNewest
+    unsigned long long getDroppedCount() const
+    {
+        return dropped.load(memory_order_relaxed);
+    }
+
+    // Number of records handed to the sink
+    unsigned long long getWrittenCount() const
+    {
+        return written.load(memory_order_relaxed);
+    }
+};
+
+// ******************************* Binary (memory-mapped) logging *******************************
+
+// Pre-allocated file mapped into memory, records are written into it with plain memcpy
+class MappedLogFile
+{
+    char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    public:
+
+    // Constructor
+#ifdef _WIN32
+    MappedLogFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {}
+#else
+    MappedLogFile() : data(nullptr), size(0), fd(-1) {}
+#endif
+
+    // Destructor
+    ~MappedLogFile()
+    {
+        close();
+    }
+
+    // Create (or truncate) the file, grow it to size bytes of zeros and map it
+    bool open(const string& path, size_t size)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+        if (mapping == NULL)
+        {
+            close();
+            return false;
+        }
+        data = (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        if (data == nullptr)
+        {
+            close();
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            close();
+            return false;
+        }
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data = (char*)memory;
+#endif
+        this->size = size;
+        return true;
+    }
+
+    // Unmap and close, the untouched tail of the file stays zero
+    void close()
+    {
+#ifdef _WIN32
+        if (data != nullptr)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != NULL)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data != nullptr)
+        {
+            munmap(data, size);
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    // Start of the mapping, nullptr if not open
+    char* begin()
+    {
+        return data;
+    }
+};
+
+// Layout of a binary log file:
+//
+//   "CLOG" 1                                     file header (magic + version)
+//   FORMAT id text                               format string, written once per file before its first use;
+//                                                ids are numbered 0, 1, 2, ... in the order a file defines them
+//   RECORD timestampDelta level id argc args...  one log record
+//   0                                            end of data (the rest of the pre-allocated file is zero)
+//
+// Numbers are varints, signed arguments are zigzag encoded, timestamps are nanoseconds since
+// the epoch stored as a delta to the previous record of the same file.
+namespace BinaryLogFormat
+{
+    const char MAGIC[4] = { 'C', 'L', 'O', 'G' };
+    const unsigned char VERSION = 2;
+    const size_t HEADER_SIZE = 5;
+
+    const unsigned char END = 0;
+    const unsigned char FORMAT = 1;
+    const unsigned char RECORD = 2;
+
+    // Maximum bytes of a varint
+    const size_t MAX_VARINT = 10;
+
+    // Write a varint, returns bytes written
+    inline size_t putVarint(char* out, unsigned long long value)
+    {
+        size_t n = 0;
+        while (value >= 0x80)
+        {
+            out[n++] = (char)(value | 0x80);
+            value >>= 7;
+        }
+        out[n++] = (char)value;
+        return n;
+    }
+
+    // Read a varint, returns false if the input ends first
+    inline bool getVarint(const char*& in, const char* end, unsigned long long& value)
+    {
+        value = 0;
+        for (int shift = 0; in < end && shift < 64; shift += 7)
+        {
+            unsigned char byte = (unsigned char)*in++;
+            value |= (unsigned long long)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Upper bound of the encoded size of one argument
+    inline size_t argSize(const LogArg& arg)
+    {
+        return 1 + (arg.type == LogArg::TEXT ? MAX_VARINT + arg.text.size() : MAX_VARINT);
+    }
+
+    // Encode one argument, returns bytes written
+    inline size_t putArg(char* out, const LogArg& arg)
+    {
+        size_t n = 0;
+        out[n++] = (char)arg.type;
+        switch (arg.type)
+        {
+            case LogArg::SIGNED:
+                n += putVarint(out + n, ((unsigned long long)arg.signedValue << 1) ^ (unsigned long long)(arg.signedValue >> 63));
+                break;
+            case LogArg::UNSIGNED:
+                n += putVarint(out + n, arg.unsignedValue);
+                break;
+            case LogArg::FLOATING:
+                memcpy(out + n, &arg.floatingValue, sizeof(double));
+                n += sizeof(double);
+                break;
+            case LogArg::CHAR:
+                out[n++] = arg.charValue;
+                break;
+            case LogArg::BOOL:
+                out[n++] = arg.boolValue ? 1 : 0;
+                break;
+            case LogArg::TEXT:
+                n += putVarint(out + n, arg.text.size());
+                memcpy(out + n, arg.text.data(), arg.text.size());
+                n += arg.text.size();
+                break;
+        }
+        return n;
+    }
+}
+
+// Sink processor that writes compact binary records for the given levels into a rotating set of
+// memory-mapped files (basePath.0.clog, basePath.1.clog, ...) and forwards every other level.
+// The hot path is a mutex (uncontended: no syscall), a few varints and a memcpy; only rotation
+// to the next file touches the file system. Use "./a.out decode <files>" to turn them into text.
+class BinaryLogSink : public LogProcessor
+{
+    string basePath;
+    size_t fileSize;
+    int maxFiles;
+    unsigned long long levelMask;
+
+    MappedLogFile file;
+    int fileIndex;
+    size_t offset;
+    unsigned long long lastTimestamp;
+
+    // Format strings, keyed by their text (views into formats, a deque never moves its strings)
+    unordered_map<string_view, unsigned int> formatIds;
+    deque<string> formats;
+
+    // Id of each format in the current file, NOT_IN_FILE until the file defines it
+    static constexpr unsigned int NOT_IN_FILE = ~0u;
+    vector<unsigned int> fileIds;
+    unsigned int fileFormatCount;
+
+    mutex writeMutex;
+    unsigned long long recordsWritten;
+    unsigned long long recordsDropped;
+    unsigned long long bytesWritten;
+
+    // Does this sink take the level
+    bool accepts(int logLevel) const
+    {
+        return logLevel >= 0 && logLevel < 64 && (levelMask >> logLevel & 1);
+    }
+
+    // Map the next file of the rotation and write its header
+    bool rotate()
+    {
+        fileIndex = (fileIndex + 1) % maxFiles;
+        offset = 0;
+        lastTimestamp = 0;
+        fileIds.assign(formats.size(), NOT_IN_FILE);
+        fileFormatCount = 0;
+        if (!file.open(basePath + "." + to_string(fileIndex) + ".clog", fileSize))
+        {
+            return false;
+        }
+        memcpy(file.begin(), BinaryLogFormat::MAGIC, sizeof(BinaryLogFormat::MAGIC));
+        file.begin()[4] = (char)BinaryLogFormat::VERSION;
+        offset = BinaryLogFormat::HEADER_SIZE;
+        return true;
+    }
+
+    // Id of a format string, registered on first use
+    unsigned int formatId(string_view fmt)
+    {
+        auto it = formatIds.find(fmt);
+        if (it != formatIds.end())
+        {
+            return it->second;
+        }
+        unsigned int id = (unsigned int)formats.size();
+        formats.emplace_back(fmt);
+        fileIds.push_back(NOT_IN_FILE);
+        formatIds.emplace(formats.back(), id);
+        return id;
+    }
+
+    // Encode one record (plus its format definition if this file has not seen it yet)
+    void write(int logLevel, string_view fmt, const LogArg* args, size_t argCount)
+    {
+        unsigned long long timestamp = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+
+        lock_guard<mutex> lock(writeMutex);
+        unsigned int id = formatId(fmt);
+
+        size_t needed = 1 + 4 * BinaryLogFormat::MAX_VARINT + 1;
+        for (size_t i = 0; i < argCount; ++i)
+        {
+            needed += BinaryLogFormat::argSize(args[i]);
+        }
+        size_t definition = 1 + 2 * BinaryLogFormat::MAX_VARINT + fmt.size();
+
+        // keep one byte for the END marker
+        if (file.begin() == nullptr || offset + definition + needed + 1 > fileSize)
+        {
+            if (BinaryLogFormat::HEADER_SIZE + definition + needed + 1 > fileSize || !rotate())
+            {
+                ++recordsDropped;
+                return;
+            }
+        }
+
+        char* out = file.begin() + offset;
+        size_t n = 0;
+        if (fileIds[id] == NOT_IN_FILE)
+        {
+            fileIds[id] = fileFormatCount++;
+            out[n++] = (char)BinaryLogFormat::FORMAT;
+            n += BinaryLogFormat::putVarint(out + n, fileIds[id]);
+            n += BinaryLogFormat::putVarint(out + n, fmt.size());
+            memcpy(out + n, fmt.data(), fmt.size());
+            n += fmt.size();
+        }
+
+        out[n++] = (char)BinaryLogFormat::RECORD;
+        n += BinaryLogFormat::putVarint(out + n, timestamp - lastTimestamp);
+        n += BinaryLogFormat::putVarint(out + n, (unsigned long long)logLevel);
+        n += BinaryLogFormat::putVarint(out + n, fileIds[id]);
+        n += BinaryLogFormat::putVarint(out + n, argCount);
+        for (size_t i = 0; i < argCount; ++i)
+        {
+            n += BinaryLogFormat::putArg(out + n, args[i]);
+        }
+
+        lastTimestamp = timestamp;
+        offset += n;
+        bytesWritten += n;
+        ++recordsWritten;
+    }
+
+    public:
+
+    // Constructor
+    BinaryLogSink(const string& basePath, initializer_list<int> levels, LogProcessor* nextLoggerProcessor,
+                  size_t fileSize = 16 << 20, int maxFiles = 4)
+        : LogProcessor(nextLoggerProcessor), basePath(basePath), fileSize(fileSize), maxFiles(maxFiles), levelMask(0),
+          fileIndex(-1), offset(0), lastTimestamp(0), fileFormatCount(0), recordsWritten(0), recordsDropped(0), bytesWritten(0)
+    {
+        for (int level : levels)
+        {
+            if (level >= 0 && level < 64)
+            {
+                levelMask |= 1ULL << level;
+            }
+        }
+    }
+
+    // Overridden log method, plain messages are stored with the "{}" format
+    void log(int logLevel, string_view message) override
+    {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
+        if (accepts(logLevel))
+        {
+            static const char plainFormat[] = "{}";
+            LogArg arg(message);
+            write(logLevel, plainFormat, &arg, 1);
+        }
+        else
+        {
+            LogProcessor::log(logLevel, message);
+        }
+    }
+
+    // Overridden formatted log method, arguments are stored packed and never formatted here
+    void logFormatted(int logLevel, string_view fmt, const LogArg* args, size_t argCount) override
+    {
+        if (accepts(logLevel))
+        {
+            write(logLevel, fmt, args, argCount);
+        }
+        else
+        {
+            LogProcessor::logFormatted(logLevel, fmt, args, argCount);
+        }
+    }
+
+    // Number of records written
+    unsigned long long getRecordsWritten() const
+    {
+        return recordsWritten;
+    }
+
+    // Number of records that did not fit into a file or could not be written
+    unsigned long long getRecordsDropped() const
+    {
+        return recordsDropped;
+    }
+
+    // Bytes written for records and format definitions
+    unsigned long long getBytesWritten() const
+    {
+        return bytesWritten;
+    }
+};
+
+// Offline decoder: replays every record of a binary log file through a processor chain,
+// so the text is exactly what the Info/Debug/Error processors print (optionally prefixed with the
+// timestamp in nanoseconds). Returns false if the file cannot be read or is corrupt.
+bool decodeBinaryLog(const string& path, LogProcessor* printer, bool showTimestamps = false)
+{
+    ifstream input(path, ios::binary);
+    if (!input)
+    {
+        return false;
+    }
+    string content((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+
+    const char* in = content.data();
+    const char* end = in + content.size();
+    if (content.size() < BinaryLogFormat::HEADER_SIZE || memcmp(in, BinaryLogFormat::MAGIC, 4) != 0 ||
+        (unsigned char)in[4] != BinaryLogFormat::VERSION)
+    {
+        return false;
+    }
+    in += BinaryLogFormat::HEADER_SIZE;
+
+    vector<string_view> formats;
+    vector<LogArg> args;
+    unsigned long long timestamp = 0;
+
+    while (in < end)
+    {
+        unsigned char kind = (unsigned char)*in++;
+        if (kind == BinaryLogFormat::END)
+        {
+            return true;
+        }
+
+        unsigned long long id, length;
+        if (kind == BinaryLogFormat::FORMAT)
+        {
+            if (!BinaryLogFormat::getVarint(in, end, id) || !BinaryLogFormat::getVarint(in, end, length) ||
+                length > (unsigned long long)(end - in))
+            {
+                return false;
+            }
+            // ids are defined in order, anything else is a corrupt file (and must not size the table)
+            if (id != formats.size())
+            {
+                return false;
+            }
+            formats.push_back(string_view(in, length));
+            in += length;
+            continue;
+        }
+
+        if (kind != BinaryLogFormat::RECORD)
+        {
+            return false;
+        }
+
+        unsigned long long delta, level, argCount;
+        if (!BinaryLogFormat::getVarint(in, end, delta) || !BinaryLogFormat::getVarint(in, end, level) ||
+            !BinaryLogFormat::getVarint(in, end, id) || !BinaryLogFormat::getVarint(in, end, argCount) ||
+            id >= formats.size())
+        {
+            return false;
+        }
+        timestamp += delta;
+
+        args.clear();
+        for (unsigned long long i = 0; i < argCount; ++i)
+        {
+            if (in >= end)
+            {
+                return false;
+            }
+            unsigned char type = (unsigned char)*in++;
+            unsigned long long value;
+            switch (type)
+            {
+                case LogArg::SIGNED:
+                    if (!BinaryLogFormat::getVarint(in, end, value))
+                    {
+                        return false;
+                    }
+                    args.emplace_back((long long)(value >> 1) ^ -(long long)(value & 1));
+                    break;
+                case LogArg::UNSIGNED:
+                    if (!BinaryLogFormat::getVarint(in, end, value))
+                    {
+                        return false;
+                    }
+                    args.emplace_back(value);
+                    break;
+                case LogArg::FLOATING:
+                {
+                    double floating;
+                    if (end - in < (ptrdiff_t)sizeof(double))
+                    {
+                        return false;
+                    }
+                    memcpy(&floating, in, sizeof(double));
+                    in += sizeof(double);
+                    args.emplace_back(floating);
+                    break;
+                }
+                case LogArg::CHAR:
+                case LogArg::BOOL:
+                    if (in >= end)
+                    {
+                        return false;
+                    }
+                    if (type == LogArg::CHAR)
+                    {
+                        args.emplace_back(*in);
+                    }
+                    else
+                    {
+                        args.emplace_back(*in != 0);
+                    }
+                    ++in;
+                    break;
+                case LogArg::TEXT:
+                    if (!BinaryLogFormat::getVarint(in, end, length) || length > (unsigned long long)(end - in))
+                    {
+                        return false;
+                    }
+                    args.emplace_back(string_view(in, length));
+                    in += length;
+                    break;
+                default:
+                    return false;
+            }
+        }
+
+        if (showTimestamps)
+        {
+            cout << "[" << timestamp << "] ";
+        }
+
+        // plain messages go through log() so they are not limited to the format buffer
+        if (formats[id] == "{}" && args.size() == 1 && args[0].type == LogArg::TEXT)
+        {
+            printer->log((int)level, args[0].text);
+        }
+        else
+        {
+            printer->logFormatted((int)level, formats[id], args.data(), args.size());
+        }
+    }
+    return true;
+}
+
+// ******************************* Per-thread buffered logging *******************************
+
+// One thread's records: single producer (the owning thread), single consumer (the merger)
+struct ThreadLogBuffer
+{
+    struct Record
+    {
+        unsigned long long timestamp;
+        unsigned long long sequence;
+        int logLevel;
+        string message;
+    };
+
+    static const size_t CAPACITY = 4096;
+
+    // inFlight values besides a timestamp
+    static const unsigned long long IDLE = ~0ULL;
+    static const unsigned long long BUSY = ~0ULL - 1;
+
+    vector<Record> records;
+    thread::id owner;
+    unsigned int threadIndex;
+    unsigned long long nextSequence;
+
+    alignas(64) atomic<size_t> head;                    // next record the merger reads
+    alignas(64) atomic<size_t> tail;                    // next slot the owner fills
+    alignas(64) atomic<unsigned long long> inFlight;    // timestamp of the record being written
+
+    // Constructor
+    ThreadLogBuffer(thread::id owner, unsigned int threadIndex)
+        : records(CAPACITY), owner(owner), threadIndex(threadIndex), nextSequence(0), head(0), tail(0), inFlight(IDLE) {}
+};
+
+// Head of the chain that gives every logging thread its own buffer, so threads never share a
+// lock or a stream while logging. A merger thread drains all buffers and writes the records
+// ordered by timestamp (ties by thread, then per-thread sequence number).
+//
+// A record is only written once no thread can still produce an older one: every thread
+// publishes the timestamp of the record it is writing (inFlight), and the merger writes only
+// records older than both "now" (taken before looking at the threads) and every inFlight value.
+class ThreadBufferedLogProcessor : public LogProcessor
+{
+    struct PendingRecord
+    {
+        unsigned long long timestamp;
+        unsigned int threadIndex;
+        unsigned long long sequence;
+        int logLevel;
+        string message;
+
+        // Ordering for the merge heap (greater = later)
+        bool operator>(const PendingRecord& other) const
+        {
+            if (timestamp != other.timestamp)
+            {
+                return timestamp > other.timestamp;
+            }
+            if (threadIndex != other.threadIndex)
+            {
+                return threadIndex > other.threadIndex;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    ostream& sink;
+    bool showTimestamps;
+    unsigned long long instanceId;
+
+    // Registered buffers, the mutex is only taken when a thread logs for the first time and by the merger
+    mutex buffersMutex;
+    vector<unique_ptr<ThreadLogBuffer>> buffers;
+
+    atomic<unsigned long long> merged;
+    atomic<bool> stopping;
+    thread merger;
+
+    // Steady clock in nanoseconds
+    static unsigned long long now()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Unique id per processor, so a thread_local cache never points into a deleted processor
+    static unsigned long long nextInstanceId()
+    {
+        static atomic<unsigned long long> counter(0);
+        return ++counter;
+    }
+
+    // Buffer of the calling thread, created on first use
+    ThreadLogBuffer* localBuffer()
+    {
+        thread_local unsigned long long cachedInstance = 0;
+        thread_local ThreadLogBuffer* cachedBuffer = nullptr;
+        if (cachedInstance == instanceId)
+        {
+            return cachedBuffer;
+        }
+
+        // the thread may have logged here before and then through another processor
+        lock_guard<mutex> lock(buffersMutex);
+        cachedInstance = instanceId;
+        cachedBuffer = nullptr;
+        for (auto& buffer : buffers)
+        {
+            if (buffer->owner == this_thread::get_id())
+            {
+                cachedBuffer = buffer.get();
+            }
+        }
+        if (cachedBuffer == nullptr)
+        {
+            buffers.emplace_back(new ThreadLogBuffer(this_thread::get_id(), (unsigned int)buffers.size()));
+            cachedBuffer = buffers.back().get();
+        }
+        return cachedBuffer;
+    }
+
+    // One merge round, returns the number of records written
+    size_t mergeOnce(priority_queue<PendingRecord, vector<PendingRecord>, greater<PendingRecord>>& pending,
+                     string& batch, bool final)
+    {
+        // Nothing older than this can still show up from a thread that is not writing right now
+        unsigned long long watermark = final ? ThreadLogBuffer::BUSY : now();
+
+        vector<ThreadLogBuffer*> snapshot;
+        {
+            lock_guard<mutex> lock(buffersMutex);
+            for (auto& buffer : buffers)
+            {
+                snapshot.push_back(buffer.get());
+            }
+        }
+
+        for (ThreadLogBuffer* buffer : snapshot)
+        {
+            unsigned long long inFlight = buffer->inFlight.load(memory_order_seq_cst);
+            if (inFlight == ThreadLogBuffer::BUSY)
+            {
+                // timestamp not known yet, only collect this round
+                watermark = 0;
+            }
+            else if (inFlight != ThreadLogBuffer::IDLE)
+            {
+                watermark = min(watermark, inFlight);
+            }
+        }
+
+        // Collect everything published so far
+        for (ThreadLogBuffer* buffer : snapshot)
+        {
+            size_t head = buffer->head.load(memory_order_relaxed);
+            size_t tail = buffer->tail.load(memory_order_acquire);
+            for (; head != tail; ++head)
+            {
+                ThreadLogBuffer::Record& record = buffer->records[head % ThreadLogBuffer::CAPACITY];
+                pending.push(PendingRecord{ record.timestamp, buffer->threadIndex, record.sequence, record.logLevel, record.message });
+            }
+            buffer->head.store(head, memory_order_release);
+        }
+
+        size_t count = 0;
+        batch.clear();
+        while (!pending.empty() && (final || pending.top().timestamp < watermark))
+        {
+            const PendingRecord& record = pending.top();
+            if (showTimestamps)
+            {
+                batch.append("[").append(to_string(record.timestamp)).append("] ");
+            }
+            LogProcessor::format(record.logLevel, record.message, batch);
+            pending.pop();
+            ++count;
+        }
+
+        if (count > 0)
+        {
+            sink.write(batch.data(), batch.size());
+            sink.flush();
+            merged.fetch_add(count, memory_order_release);
+        }
+        return count;
+    }
+
+    // Merge until stopped, then write whatever is left
+    void mergerLoop()
+    {
+        priority_queue<PendingRecord, vector<PendingRecord>, greater<PendingRecord>> pending;
+        string batch;
+        while (!stopping.load(memory_order_acquire))
+        {
+            if (mergeOnce(pending, batch, false) == 0)
+            {
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        }
+        mergeOnce(pending, batch, true);
+    }
+
+    public:
+
+    // Constructor
+    ThreadBufferedLogProcessor(LogProcessor* nextLoggerProcessor, ostream& sink = cout, bool showTimestamps = false)
+        : LogProcessor(nextLoggerProcessor), sink(sink), showTimestamps(showTimestamps), instanceId(nextInstanceId()),
+          merged(0), stopping(false)
+    {
+        merger = thread(&ThreadBufferedLogProcessor::mergerLoop, this);
+    }
+
+    // Destructor, the logging threads must be done by now
+    ~ThreadBufferedLogProcessor() override
+    {
+        stopping.store(true, memory_order_release);
+        merger.join();
+    }
+
+    // Overridden log method, appends to the calling thread's buffer
+    void log(int logLevel, string_view message) override
+    {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
+        ThreadLogBuffer* buffer = localBuffer();
+
+        // BUSY first, so the merger never trusts a clock reading older than our timestamp
+        buffer->inFlight.store(ThreadLogBuffer::BUSY, memory_order_seq_cst);
+        unsigned long long timestamp = now();
+        buffer->inFlight.store(timestamp, memory_order_seq_cst);
+
+        size_t tail = buffer->tail.load(memory_order_relaxed);
+        while (tail - buffer->head.load(memory_order_acquire) == ThreadLogBuffer::CAPACITY)
+        {
+            // buffer full, the merger can still write our older records
+            this_thread::yield();
+        }
+
+        ThreadLogBuffer::Record& record = buffer->records[tail % ThreadLogBuffer::CAPACITY];
+        record.timestamp = timestamp;
+        record.sequence = buffer->nextSequence++;
+        record.logLevel = logLevel;
+        record.message.assign(message);
+        buffer->tail.store(tail + 1, memory_order_release);
+
+        buffer->inFlight.store(ThreadLogBuffer::IDLE, memory_order_release);
+    }
+
+    // Overridden formatted log method, formats on the caller's stack and buffers the text
+    void logFormatted(int logLevel, string_view fmt, const LogArg* args, size_t argCount) override
+    {
+        LogLineBuffer line;
+        line.format(fmt, args, argCount);
+        log(logLevel, line.view());
+    }
+
+    // Wait until every record logged so far has been written
+    void flush()
+    {
+        unsigned long long logged = 0;
+        {
+            lock_guard<mutex> lock(buffersMutex);
+            for (auto& buffer : buffers)
+            {
+                logged += buffer->tail.load(memory_order_acquire);
+            }
+        }
+        while (merged.load(memory_order_acquire) < logged)
+        {
+            this_thread::yield();
+        }
+    }
+
+    // Number of records written by the merger
+    unsigned long long getMergedCount() const
+    {
+        return merged.load(memory_order_relaxed);
+    }
+};
+
+// ******************************* Benchmark *******************************
+
+#if LOG_COUNT_ALLOCATIONS
+// Global allocation counter, used by the allocation check
+static atomic<unsigned long long> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+// GCC cannot see that operator new above is malloc based and warns about free() once this is inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+#endif
+
+// Stream buffer that only counts the characters written to it, the allocation check points cout at it
+class CountingStreamBuffer : public streambuf
+{
+    public:
+
+    unsigned long long count = 0;
+
+    protected:
+
+    int overflow(int c) override
+    {
+        ++count;
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char*, streamsize n) override
+    {
+        count += n;
+        return n;
+    }
+};
+
+// Processor that only counts the records it handles, so the benchmark measures dispatch and not cout
+class CountingLogProcessor : public LogProcessor
+{
+    int level;
+
+    public:
+
+    unsigned long long count;
+
+    // Constructor
+    CountingLogProcessor(int level, LogProcessor* nextLoggerProcessor)
+        : LogProcessor(nextLoggerProcessor), level(level), count(0) {}
+
+    int getLevel() const override
+    {
+        return level;
+    }
+
+    void handle(int, string_view message) override
+    {
+        count += message.size();
+    }
+
+    void log(int logLevel, string_view message) override
+    {
+        if (belowMinLevel(logLevel))
+        {
+            return;
+        }
+
+        if (logLevel == level)
+        {
+            handle(logLevel, message);
+        }
+        else
+        {
+            LogProcessor::log(logLevel, message);
+        }
+    }
+};
+
+// Per-record cost of the linear chain walk vs the compiled dispatch table
+void runDispatchBenchmark()
+{
+    const int records = 2000000;
+    const string message = "benchmark record";
+
+    for (int processors : {3, 16, 64})
+    {
+        // levels 1..processors, level 1 at the head of the chain
+        LogProcessor* chain = nullptr;
+        for (int level = processors; level >= 1; --level)
+        {
+            chain = new CountingLogProcessor(level, chain);
+        }
+        LogDispatchTable table(chain);
+
+        // Uniformly spread levels, precomputed so the loop only measures dispatch
+        vector<int> levels(records);
+        unsigned int seed = 12345;
+        for (int i = 0; i < records; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            levels[i] = 1 + (seed >> 16) % processors;
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < records; ++i)
+        {
+            chain->log(levels[i], message);
+        }
+        auto middle = chrono::steady_clock::now();
+        for (int i = 0; i < records; ++i)
+        {
+            table.log(levels[i], message);
+        }
+        auto end = chrono::steady_clock::now();
+
+        double chainNs = chrono::duration<double, nano>(middle - start).count() / records;
+        double tableNs = chrono::duration<double, nano>(end - middle).count() / records;
+        cout << processors << " processors: chain " << chainNs << " ns/record, table " << tableNs << " ns/record" << endl;
+
+        delete chain;
+    }
+}
+
+// Allocation check: the accepted and the filtered path of log()/logf() and of the dispatch table must not
+// touch the heap. Runs the real INFO -> DEBUG -> ERROR chain with cout pointed at a counting buffer.
+// Returns false on failure
+bool runAllocationCheck()
+{
+#if LOG_COUNT_ALLOCATIONS
+    const int records = 100000;
+    const int WARN = 4;
+
+    // INFO, DEBUG and ERROR are handled, WARN is filtered out (nobody in the chain accepts it)
+    LogProcessor* chain = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr)));
+    LogDispatchTable table(chain);
+    string user = "alice";
+
+    CountingStreamBuffer output;
+    streambuf* console = cout.rdbuf(&output);
+
+    // warm up once so lazy runtime allocations are not counted
+    chain->logf<LogProcessor::ERROR>("user {} failed {} times", user, 1);
+
+    unsigned long long before = allocationCount.load();
+    for (int i = 0; i < records; ++i)
+    {
+        chain->log(LogProcessor::INFO, "short message");
+        chain->logf<LogProcessor::ERROR>("user {} failed {} times ({}%)", user, i, 12.5);
+        chain->logf<LogProcessor::DEBUG>("retry {}", i);
+        chain->log(WARN, "filtered");
+        chain->logf<WARN>("filtered {}", i);
+        table.log(LogProcessor::DEBUG, "short message (table)");
+    }
+    unsigned long long allocations = allocationCount.load() - before;
+
+    cout.rdbuf(console);
+    bool handled = output.count > 0;
+    delete chain;
+
+    cout << "allocations for " << 6 * records << " log calls: " << allocations << (allocations == 0 && handled ? " (PASS)" : " (FAIL)") << endl;
+    return allocations == 0 && handled;
+#else
+    cout << "allocation counting is off, build with -DLOG_COUNT_ALLOCATIONS=1" << endl;
+    return false;
+#endif
+}
+
+// Binary sink: round trip through the decoder, then bytes and ns per record against the text format
+void runBinaryLogBenchmark()
+{
+    // Round trip, the decoded text must match what the text chain prints
+    LogProcessor* binaryChain = new BinaryLogSink("binary_log_demo", { LogProcessor::DEBUG, LogProcessor::ERROR },
+                                                  new InfoLogProcessor(nullptr));
+    binaryChain->log(LogProcessor::ERROR, "exception happens");
+    binaryChain->log(LogProcessor::DEBUG, "need to debug this");
+    binaryChain->log(LogProcessor::INFO, "just for information");
+    binaryChain->logf<LogProcessor::ERROR>("request {} failed after {} ms", "GET /cart", 42);
+    delete binaryChain;
+
+    cout << "decoded:" << endl;
+    LogProcessor* printer = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr)));
+    decodeBinaryLog("binary_log_demo.0.clog", printer);
+
+    // Throughput and size
+    const int records = 1000000;
+    BinaryLogSink* sink = new BinaryLogSink("binary_log_bench", { LogProcessor::DEBUG, LogProcessor::ERROR }, nullptr, 64 << 20, 2);
+    string user = "alice";
+    unsigned long long textBytes = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < records; ++i)
+    {
+        sink->logf<LogProcessor::ERROR>("user {} failed to check out cart {} after {} retries", user, 100000 + i, i % 7);
+    }
+    auto end = chrono::steady_clock::now();
+
+    // Size of the same records as text ("ERROR: ...\n")
+    for (int i = 0; i < records; ++i)
+    {
+        LogLineBuffer line;
+        LogArg args[] = { LogArg(user), LogArg(100000 + i), LogArg(i % 7) };
+        line.format("user {} failed to check out cart {} after {} retries", args, 3);
+        textBytes += 7 + line.view().size() + 1;
+    }
+
+    double ns = chrono::duration<double, nano>(end - start).count() / records;
+    cout << "binary: " << (double)sink->getBytesWritten() / sink->getRecordsWritten() << " bytes/record, "
+         << ns << " ns/record" << endl;
+    cout << "text:   " << (double)textBytes / records << " bytes/record" << endl;
+
+    delete sink;
+    delete printer;
+}
+
+// Per-thread buffers: 8..64 threads log concurrently, the merged output must be ordered by
+// timestamp and keep every thread's records in sequence. Returns false on failure.
+bool runThreadBufferStressTest()
+{
+    const int totalRecords = 400000;
+    bool passed = true;
+
+    for (int threadCount : {8, 16, 32, 64})
+    {
+        ostringstream output;
+        ThreadBufferedLogProcessor* logger = new ThreadBufferedLogProcessor(
+            new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr))), output, true);
+
+        int perThread = totalRecords / threadCount;
+        auto start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([logger, t, perThread]()
+            {
+                for (int i = 0; i < perThread; ++i)
+                {
+                    logger->logf<LogProcessor::INFO>("thread {} record {}", t, i);
+                }
+            });
+        }
+        for (auto& th : threads)
+        {
+            th.join();
+        }
+        logger->flush();
+        auto end = chrono::steady_clock::now();
+        delete logger;
+
+        // Check: "[timestamp] INFO: thread <t> record <i>"
+        istringstream lines(output.str());
+        string line;
+        unsigned long long lastTimestamp = 0;
+        vector<int> expected(threadCount, 0);
+        long long records = 0;
+        bool ordered = true;
+        while (getline(lines, line))
+        {
+            unsigned long long timestamp;
+            int t, i;
+            if (sscanf(line.c_str(), "[%llu] INFO: thread %d record %d", &timestamp, &t, &i) != 3 ||
+                t < 0 || t >= threadCount || timestamp < lastTimestamp || i != expected[t])
+            {
+                ordered = false;
+                break;
+            }
+            lastTimestamp = timestamp;
+            ++expected[t];
+            ++records;
+        }
+        bool complete = records == (long long)perThread * threadCount;
+
+        double seconds = chrono::duration<double>(end - start).count();
+        cout << threadCount << " threads: " << (long long)(records / seconds) << " records/sec"
+             << ((ordered && complete) ? " (PASS)" : " (FAIL)") << endl;
+        passed = passed && ordered && complete;
+    }
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    // ./a.out bench  -> run the benchmarks instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runDispatchBenchmark();
+        return 0;
+    }
+
+    // ./a.out alloc  -> run the allocation check
+    if (argc > 1 && string(argv[1]) == "alloc")
+    {
+        return runAllocationCheck() ? 0 : 1;
+    }
+
+    // ./a.out binlog  -> binary sink round trip and size/speed against text
+    if (argc > 1 && string(argv[1]) == "binlog")
+    {
+        runBinaryLogBenchmark();
+        return 0;
+    }
+
+    // ./a.out stress  -> per-thread buffers with 8..64 threads, ordering check and records/sec
+    if (argc > 1 && string(argv[1]) == "stress")
+    {
+        return runThreadBufferStressTest() ? 0 : 1;
+    }
+
+    // ./a.out decode <file.clog>...  -> print binary log files as text
+    if (argc > 1 && string(argv[1]) == "decode")
+    {
+        LogProcessor* printer = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr)));
+        int status = 0;
+        for (int i = 2; i < argc; ++i)
+        {
+            if (!decodeBinaryLog(argv[i], printer))
+            {
+                cerr << "cannot decode " << argv[i] << endl;
+                status = 1;
+            }
+        }
+        delete printer;
+        return status;
+    }
+
+    // Creating an instance of the log chain with INFO -> DEBUG -> ERROR order
+    LogProcessor* logObject = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr)));
+    
+    // Logging different messages with different log levels
+    logObject->log(LogProcessor::ERROR, "exception happens");
+    
+    logObject->log(LogProcessor::DEBUG, "need to debug this");
+    
+    logObject->log(LogProcessor::INFO, "just for information");
+
+    // Same chain compiled into a level-indexed table, with user-added WARN and (sparse) AUDIT levels at the end
+    const int WARN = 4;
+    const int AUDIT = 1000000000;
+    LogProcessor* tableChain = new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(
+        new CustomLogProcessor(WARN, "WARN", new CustomLogProcessor(AUDIT, "AUDIT", nullptr)))));
+    LogDispatchTable dispatchTable(tableChain);
+
+    dispatchTable.log(LogProcessor::ERROR, "exception happens (table)");
+
+    dispatchTable.log(WARN, "disk almost full (table)");
+
+    dispatchTable.log(AUDIT, "settings changed (table)");
+
+    // Structured logging, formatted only by the processor that accepts the level
+    tableChain->logf<LogProcessor::ERROR>("request {} failed after {} ms", "GET /cart", 42);
+
+    delete tableChain;
+    
+    // Clean up dynamic memory
+    delete logObject;
+
+    // Async mode: same chain behind AsyncLogProcessor, callers only enqueue
+    AsyncLogProcessor* asyncLogObject = new AsyncLogProcessor(
+        new InfoLogProcessor(new DebugLogProcessor(new ErrorLogProcessor(nullptr))), 1024, OverflowPolicy::DropNewest);
+
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([asyncLogObject, t]()
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                asyncLogObject->log(LogProcessor::INFO, "async record " + to_string(i) + " from thread " + to_string(t));
+            }
+        });
+    }
+    for (auto& th : threads)
+    {
+        th.join();
+    }
+
+    asyncLogObject->flush();
+    cout << "enqueued: " << asyncLogObject->getEnqueuedCount()
+         << ", dropped: " << asyncLogObject->getDroppedCount() << endl;
+
+    delete asyncLogObject;
 
     return 0;
 }
\ No newline at end of file
@@ -56,7 +56,7 @@ cost of the wrapped pizza.
 
 In the main() function:
 We create instances of different pizza configurations and calculate their costs.
-We delete dynamically allocated objects to prevent memory leaks.
+We delete the outermost layer of each pizza, which frees every topping under it, and build one order in an OrderArena.
 
 --------------------------------------------------------------------------------------------------------------------
 Steps to create decorator design pattern?
@@ -115,11 +115,129 @@ ToppingDecorator has a "has-a" relationship with BasePizza, as it wraps a BasePi
 
 Mushroom also indirectly has a "has-a" relationship with BasePizza through ToppingDecorator.
 
+--------------------------------------------------------------------------------------------------------------------
+Frozen pizzas:->
+
+A chain like Onion(Mushroom(ExtraCheese(vegDelight))) is a linked list on the heap and cost() makes one virtual
+call per layer. FrozenPizza(chain) flattens it once into a single record: the base id, the toppings in one
+array (innermost first) and the total, so its cost() is O(1). Pizzas are still built with the decorators.
+
+Decorated<Marghrita, ExtraCheese, Mushroom> is the compile-time form for menu items: same price as
+Mushroom(ExtraCheese(Marghrita)) but its cost is a constant (checked by static_assert), and it is a BasePizza,
+so menu items and custom orders go through the same code.
+
+Prices live in PriceTable::current(), not in the classes; setPrice() bumps the table's version. Every decorator
+caches its cost with the version it was computed at, so cost() is O(1) until the prices change and the caches
+go stale lazily (frozen records and Decorated pizzas follow the table too).
+
+PizzaCart keeps a whole cart as columns (base id, count of each topping, up to 255; addCounts(),
+addToppingBits() or add() of a decorated pizza) and priceCart() prices it in one pass: base price + counts . topping prices, 8 pizzas at
+a time with AVX2 when the CPU has it. "./a.out check" compares it with cost() of the decorator classes.
+
+Each topping made with new owns (and deletes) the pizza it wraps, so deleting the outermost layer frees the
+whole pizza. OrderArena builds all the pizzas of an order in one block instead: arena.make<Onion>(arena.make<
+Marghrita>()) does no malloc for a usual order, marks the toppings it builds as not owning their pizza, and
+the whole order is freed at once, without running destructors.
+
+run "./a.out bench" to compare cost() of chains and frozen records for 1 to 64 toppings (cold: just after a
+price change, warm: cached), of runtime and compile-time menu items, batch cart pricing, and orders built
+with new/delete vs in an OrderArena.
+
+compile:- g++ -std=c++17 -O2 decorator_design_pattern_pizza.cpp
+
 */
 
 #include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <new>
+#include <cstddef>
+#include <stdexcept>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PIZZA_CART_AVX2 1
+#endif
 using namespace std;
 
+// Ids of the base pizzas and of the toppings, used by flattened pizzas
+enum class PizzaBase : uint8_t { Farmhouse, Marghrita, vegDelight, None };
+enum class Topping : uint8_t { ExtraCheese, Mushroom, Onion };
+
+// Prices of the menu, changeable at runtime; every change bumps the version, so cached costs computed
+// with older prices are recomputed on their next cost() (version 0 = the build-time default prices)
+// Not thread-safe, like the pizzas themselves
+class PriceTable
+{
+    // Build-time prices, the menu starts with these
+    static constexpr int DEFAULT_BASE_PRICES[4] = { 200, 150, 180, 0 };   // Farmhouse, Marghrita, vegDelight, None
+    static constexpr int DEFAULT_TOPPING_PRICES[3] = { 10, 15, 20 };      // ExtraCheese, Mushroom, Onion
+
+    int basePrices[4];
+    int toppingPrices[3];
+    unsigned long long changes = 0;
+
+    PriceTable()
+    {
+        copy(begin(DEFAULT_BASE_PRICES), end(DEFAULT_BASE_PRICES), basePrices);
+        copy(begin(DEFAULT_TOPPING_PRICES), end(DEFAULT_TOPPING_PRICES), toppingPrices);
+    }
+
+    public:
+
+    static constexpr int defaultPrice(PizzaBase base)
+    {
+        return DEFAULT_BASE_PRICES[(int)base];
+    }
+
+    static constexpr int defaultPrice(Topping topping)
+    {
+        return DEFAULT_TOPPING_PRICES[(int)topping];
+    }
+
+    // The menu's price table
+    static PriceTable& current()
+    {
+        static PriceTable table;
+        return table;
+    }
+
+    int price(PizzaBase base) const
+    {
+        return basePrices[(int)base];
+    }
+
+    int price(Topping topping) const
+    {
+        return toppingPrices[(int)topping];
+    }
+
+    void setPrice(PizzaBase base, int price)
+    {
+        basePrices[(int)base] = price;
+        ++changes;
+    }
+
+    void setPrice(Topping topping, int price)
+    {
+        toppingPrices[(int)topping] = price;
+        ++changes;
+    }
+
+    // Number of price changes so far
+    unsigned long long version() const
+    {
+        return changes;
+    }
+};
+
+class FrozenPizza;
+
 // Interface class for all types of pizza
 class BasePizza
 {
@@ -127,17 +245,78 @@ class BasePizza
     
     // Virtual function to calculate the cost of the pizza
     virtual int cost() = 0;
+
+    // Virtual function writing the base and the toppings (innermost first) into a flat record
+    virtual void flatten(FrozenPizza& record) = 0;
+
+    // Virtual destructor, pizzas are deleted through BasePizza pointers
+    virtual ~BasePizza() {}
+};
+
+// A decorator chain flattened into one record: base id, toppings in one array and the total cost
+class FrozenPizza : public BasePizza
+{
+    public:
+
+    PizzaBase base = PizzaBase::None;
+    vector<Topping> toppings;
+    int total = 0;
+    unsigned long long totalVersion = 0;
+
+    // Default constructor, for flatten() to fill
+    FrozenPizza() {}
+
+    // Flatten a pizza built with the decorators; its cost() is computed once, here
+    explicit FrozenPizza(BasePizza* pizza)
+    {
+        pizza->flatten(*this);
+        total = pizza->cost();
+        totalVersion = PriceTable::current().version();
+    }
+
+    // Cost of the pizza, precomputed (again from the record after a price change)
+    int cost() override
+    {
+        const PriceTable& prices = PriceTable::current();
+        if (totalVersion != prices.version())
+        {
+            total = prices.price(base);
+            for (Topping topping : toppings)
+            {
+                total += prices.price(topping);
+            }
+            totalVersion = prices.version();
+        }
+        return total;
+    }
+
+    // A frozen pizza decorated again flattens to its own record
+    void flatten(FrozenPizza& record) override
+    {
+        record.base = base;
+        record.toppings.insert(record.toppings.end(), toppings.begin(), toppings.end());
+    }
 };
 
 // Concrete pizza class representing Farmhouse pizza
 class Farmhouse : public BasePizza
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(PizzaBase::Farmhouse);
+    static constexpr PizzaBase ID = PizzaBase::Farmhouse;
     
-    // Cost of Farmhouse pizza
+    // Cost of Farmhouse pizza, from the price table
     int cost() override
     {
-        return 200;
+        return PriceTable::current().price(ID);
+    }
+
+    // Flat record of the pizza
+    void flatten(FrozenPizza& record) override
+    {
+        record.base = PizzaBase::Farmhouse;
     }
 };
 
@@ -145,11 +324,21 @@ class Farmhouse : public BasePizza
 class Marghrita : public BasePizza
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(PizzaBase::Marghrita);
+    static constexpr PizzaBase ID = PizzaBase::Marghrita;
     
-    // Cost of Marghrita pizza
+    // Cost of Marghrita pizza, from the price table
     int cost() override
     {
-        return 150;
+        return PriceTable::current().price(ID);
+    }
+
+    // Flat record of the pizza
+    void flatten(FrozenPizza& record) override
+    {
+        record.base = PizzaBase::Marghrita;
     }
 };
 
@@ -157,32 +346,89 @@ class Marghrita : public BasePizza
 class vegDelight : public BasePizza
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(PizzaBase::vegDelight);
+    static constexpr PizzaBase ID = PizzaBase::vegDelight;
     
-    // Cost of vegDelight pizza
+    // Cost of vegDelight pizza, from the price table
     int cost() override
     {
-        return 180;
+        return PriceTable::current().price(ID);
+    }
+
+    // Flat record of the pizza
+    void flatten(FrozenPizza& record) override
+    {
+        record.base = PizzaBase::vegDelight;
     }
 };
 
+class OrderArena;
+
 // Abstract decorator class extending BasePizza
 // It has-a relation with BasePizza
 class ToppingDecorator : public BasePizza
 {
+    friend class OrderArena;
+
+    // Whether the destructor deletes the wrapped pizza: true for decorators made with new, false for the
+    // ones OrderArena::make() builds (the arena frees their pizza)
+    bool ownsPizza = true;
+
     protected:
     
     // Pointer to the base pizza
     BasePizza *basepizza; 
 
+    // Cost computed by the last cost() and the price table version it was computed with
+    int cachedCost = 0;
+    unsigned long long cachedVersion = ~0ull;
+
+    // Cost of the pizza with this topping, walks the wrapped pizza
+    virtual int computeCost()
+    {
+        return basepizza->cost();
+    }
+
     public:
     
-    // Constructor
+    // Constructor, the decorator owns the pizza it wraps, which must come from new (unless OrderArena::make()
+    // built the decorator)
     ToppingDecorator(BasePizza *pizza) : basepizza(pizza) {}
 
-    // Override cost() method to delegate to the wrapped pizza
+    // Destructor, deleting the outermost topping deletes the whole pizza
+    ~ToppingDecorator() override
+    {
+        if (ownsPizza)
+        {
+            delete basepizza;
+        }
+    }
+
+    ToppingDecorator(const ToppingDecorator&) = delete;
+    ToppingDecorator& operator=(const ToppingDecorator&) = delete;
+
+    // Cost, computed once per price table version (O(1) until the prices change)
     int cost() override
     {
-        return basepizza->cost();
+        unsigned long long version = PriceTable::current().version();
+        if (cachedVersion != version)
+        {
+            cachedCost = computeCost();
+            cachedVersion = version;
+        }
+        return cachedCost;
+    }
+
+    // Topping added by this decorator
+    virtual Topping topping() = 0;
+
+    // Flat record: the wrapped pizza first, then this topping
+    void flatten(FrozenPizza& record) override
+    {
+        basepizza->flatten(record);
+        record.toppings.push_back(topping());
     }
 };
 
@@ -191,14 +437,26 @@ class ToppingDecorator : public BasePizza
 class ExtraCheese : public ToppingDecorator
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(Topping::ExtraCheese);
+    static constexpr Topping ID = Topping::ExtraCheese;
     
     // Constructor
     ExtraCheese(BasePizza *pizza) : ToppingDecorator(pizza) {}
 
-    // Override cost() method to add cost of extra cheese
-    int cost() override
+    // Topping added
+    Topping topping() override
+    {
+        return ID;
+    }
+
+    protected:
+
+    // Override computeCost() method to add cost of extra cheese
+    int computeCost() override
     {
-        return basepizza->cost() + 10;
+        return basepizza->cost() + PriceTable::current().price(ID);
     }
 };
 
@@ -207,14 +465,26 @@ class ExtraCheese : public ToppingDecorator
 class Mushroom : public ToppingDecorator
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(Topping::Mushroom);
+    static constexpr Topping ID = Topping::Mushroom;
     
     // Constructor
     Mushroom(BasePizza *pizza) : ToppingDecorator(pizza) {}
 
-    // Override cost() method to add cost of mushroom
-    int cost() override
+    // Topping added
+    Topping topping() override
     {
-        return basepizza->cost() + 15;
+        return ID;
+    }
+
+    protected:
+
+    // Override computeCost() method to add cost of mushroom
+    int computeCost() override
+    {
+        return basepizza->cost() + PriceTable::current().price(ID);
     }
 };
 
@@ -223,21 +493,759 @@ class Mushroom : public ToppingDecorator
 class Onion : public ToppingDecorator
 {
     public:
+
+    // Build-time price and id
+    static constexpr int PRICE = PriceTable::defaultPrice(Topping::Onion);
+    static constexpr Topping ID = Topping::Onion;
     
     // Constructor
     Onion(BasePizza *pizza) : ToppingDecorator(pizza) {}
 
-    // Override cost() method to add cost of onion
-    int cost() override
+    // Topping added
+    Topping topping() override
+    {
+        return ID;
+    }
+
+    protected:
+
+    // Override computeCost() method to add cost of onion
+    int computeCost() override
     {
         // this will also work as ToppingDecorator Constructor contain basepizza
-        // return ToppingDecorator::cost() + 20;
-        return basepizza->cost() + 20;
+        // return ToppingDecorator::computeCost() + PriceTable::current().price(ID);
+        return basepizza->cost() + PriceTable::current().price(ID);
     }
 };
 
-int main()
+// Pizza with toppings known at compile time: Decorated<Marghrita, ExtraCheese, Mushroom> is priced like
+// new Mushroom(new ExtraCheese(new Marghrita())) (toppings innermost first), but while the menu prices are
+// unchanged its cost is a constant folded by the compiler, and it is still a BasePizza for code that mixes it
+// with custom orders
+template<typename Base, typename... Toppings>
+class Decorated final : public BasePizza
+{
+    static_assert(is_base_of<BasePizza, Base>::value && !is_base_of<ToppingDecorator, Base>::value,
+                  "the first type must be a base pizza");
+    static_assert((is_base_of<ToppingDecorator, Toppings>::value && ...), "the other types must be toppings");
+
+    public:
+
+    // Cost with the build-time prices, computed at compile time
+    static constexpr int staticCost()
+    {
+        return Base::PRICE + (0 + ... + Toppings::PRICE);
+    }
+
+    // The constant until the prices change, then from the price table like every other pizza
+    int cost() override
+    {
+        const PriceTable& prices = PriceTable::current();
+        if (prices.version() == 0)
+        {
+            return staticCost();
+        }
+        return prices.price(Base::ID) + (0 + ... + prices.price(Toppings::ID));
+    }
+
+    // Flat record of the pizza
+    void flatten(FrozenPizza& record) override
+    {
+        record.base = Base::ID;
+        (record.toppings.push_back(Toppings::ID), ...);
+    }
+};
+
+// The menu's compile-time pizzas; the static_asserts prove the costs fold to constants
+typedef Decorated<Marghrita, ExtraCheese> CheeseMarghrita;
+typedef Decorated<Marghrita, ExtraCheese, Mushroom> CheeseMushroomMarghrita;
+typedef Decorated<vegDelight, ExtraCheese, Mushroom, Onion> LoadedVegDelight;
+static_assert(CheeseMarghrita::staticCost() == 160, "Marghrita + extra cheese");
+static_assert(CheeseMushroomMarghrita::staticCost() == 175, "Marghrita + extra cheese + mushroom");
+static_assert(LoadedVegDelight::staticCost() == 225, "vegDelight + extra cheese + mushroom + onion");
+
+// A cart of pizzas for batch pricing, one column per field: the base id and how many of each topping
+// (a pizza is a row; counts up to 255 of one topping)
+class PizzaCart
+{
+    public:
+
+    static constexpr int TOPPING_KINDS = 3;
+    static constexpr int MAX_COUNT = 255;
+
+    vector<uint8_t> base;
+    vector<uint8_t> count[TOPPING_KINDS];
+
+    // Add a pizza from its base and topping counts
+    void addCounts(PizzaBase pizzaBase, const uint8_t counts[TOPPING_KINDS])
+    {
+        base.push_back((uint8_t)pizzaBase);
+        for (int t = 0; t < TOPPING_KINDS; ++t)
+        {
+            count[t].push_back(counts[t]);
+        }
+    }
+
+    // Add a pizza from its base and a bitset of toppings (bit t = Topping t, once each)
+    void addToppingBits(PizzaBase pizzaBase, unsigned toppingBits)
+    {
+        uint8_t counts[TOPPING_KINDS];
+        for (int t = 0; t < TOPPING_KINDS; ++t)
+        {
+            counts[t] = (toppingBits >> t) & 1;
+        }
+        addCounts(pizzaBase, counts);
+    }
+
+    // Add a pizza built with the decorators, throws out_of_range (and adds nothing) if it has more than
+    // MAX_COUNT of one topping
+    void add(BasePizza* pizza)
+    {
+        FrozenPizza record;
+        pizza->flatten(record);
+        uint8_t counts[TOPPING_KINDS] = {};
+        for (Topping topping : record.toppings)
+        {
+            if (counts[(int)topping] == MAX_COUNT)
+            {
+                throw out_of_range("PizzaCart: more than 255 of one topping");
+            }
+            ++counts[(int)topping];
+        }
+        addCounts(record.base, counts);
+    }
+
+    size_t size() const
+    {
+        return base.size();
+    }
+
+    void clear()
+    {
+        base.clear();
+        for (auto& column : count)
+        {
+            column.clear();
+        }
+    }
+};
+
+// Kernel pricing pizzas [first, last) of a cart: total = base price + counts . topping prices
+typedef void (*CartKernel)(const PizzaCart& cart, const int* basePrices, const int* toppingPrices, int* totals,
+                           size_t first, size_t last);
+
+// Portable kernel, also the reference for the vectorized one
+void priceCartScalar(const PizzaCart& cart, const int* basePrices, const int* toppingPrices, int* totals,
+                     size_t first, size_t last)
 {
+    for (size_t i = first; i < last; ++i)
+    {
+        totals[i] = basePrices[cart.base[i]] + cart.count[0][i] * toppingPrices[0] + cart.count[1][i] * toppingPrices[1] +
+                    cart.count[2][i] * toppingPrices[2];
+    }
+}
+
+#ifdef PIZZA_CART_AVX2
+// 8 pizzas per step: widen the byte columns, gather the base prices, multiply-add the topping prices
+__attribute__((target("avx2")))
+void priceCartAvx2(const PizzaCart& cart, const int* basePrices, const int* toppingPrices, int* totals,
+                   size_t first, size_t last)
+{
+    const __m256i cheese = _mm256_set1_epi32(toppingPrices[0]);
+    const __m256i mushroom = _mm256_set1_epi32(toppingPrices[1]);
+    const __m256i onion = _mm256_set1_epi32(toppingPrices[2]);
+    // 8 bytes of a column widened to 8 ints
+#define PIZZA_CART_WIDEN(column) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)((column).data() + i)))
+    size_t i = first;
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256i total = _mm256_i32gather_epi32(basePrices, PIZZA_CART_WIDEN(cart.base), 4);
+        total = _mm256_add_epi32(total, _mm256_mullo_epi32(PIZZA_CART_WIDEN(cart.count[0]), cheese));
+        total = _mm256_add_epi32(total, _mm256_mullo_epi32(PIZZA_CART_WIDEN(cart.count[1]), mushroom));
+        total = _mm256_add_epi32(total, _mm256_mullo_epi32(PIZZA_CART_WIDEN(cart.count[2]), onion));
+        _mm256_storeu_si256((__m256i*)(totals + i), total);
+    }
+#undef PIZZA_CART_WIDEN
+    priceCartScalar(cart, basePrices, toppingPrices, totals, i, last);
+}
+#endif
+
+// Kernel for this CPU, chosen once at first use
+struct CartKernelChoice
+{
+    CartKernel kernel;
+    const char* name;
+};
+
+const CartKernelChoice& cartKernel()
+{
+    static const CartKernelChoice choice = []
+    {
+#ifdef PIZZA_CART_AVX2
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return CartKernelChoice{ &priceCartAvx2, "avx2" };
+        }
+#endif
+        return CartKernelChoice{ &priceCartScalar, "scalar" };
+    }();
+    return choice;
+}
+
+// Price every pizza of the cart with the current price table, returns the cart total
+long long priceCart(const PizzaCart& cart, vector<int>& totals, CartKernel kernel = cartKernel().kernel)
+{
+    const PriceTable& prices = PriceTable::current();
+    int basePrices[4];
+    int toppingPrices[PizzaCart::TOPPING_KINDS];
+    for (int b = 0; b < 4; ++b)
+    {
+        basePrices[b] = prices.price((PizzaBase)b);
+    }
+    for (int t = 0; t < PizzaCart::TOPPING_KINDS; ++t)
+    {
+        toppingPrices[t] = prices.price((Topping)t);
+    }
+    totals.resize(cart.size());
+    kernel(cart, basePrices, toppingPrices, totals.data(), 0, cart.size());
+    long long sum = 0;
+    for (int total : totals)
+    {
+        sum += total;
+    }
+    return sum;
+}
+
+// Memory for the pizzas of one order: bump allocation in an inline block, so a usual order does no malloc at
+// all; bigger orders get heap chunks, kept in a list through their headers so the chunks are the arena's only
+// allocations. The whole order is freed at once by reset() or the destructor.
+// Destructors are not run. make() marks the decorators it builds as not owning their pizza, and refuses to
+// wrap a pizza from anywhere else, so every layer of a pizza lives in the same arena; never delete one.
+// FrozenPizza owns a vector and does not belong here.
+class OrderArena
+{
+    static const size_t INLINE_SIZE = 4096;
+    static const size_t CHUNK_SIZE = 1 << 16;
+
+    // Heap chunk, linked to the chunk allocated before it
+    struct Chunk
+    {
+        Chunk* previous;
+        alignas(alignof(max_align_t)) char memory[CHUNK_SIZE];
+    };
+
+    alignas(alignof(max_align_t)) char inlineBlock[INLINE_SIZE];
+    Chunk* lastChunk = nullptr;
+    char* cursor;
+    char* limit;
+    unsigned long long chunkAllocations = 0;
+
+    public:
+
+    // Constructor
+    OrderArena() : cursor(inlineBlock), limit(inlineBlock + INLINE_SIZE) {}
+
+    // Destructor
+    ~OrderArena()
+    {
+        reset();
+    }
+
+    OrderArena(const OrderArena&) = delete;
+    OrderArena& operator=(const OrderArena&) = delete;
+
+    // Bump allocate, throws bad_alloc if the object does not fit into a chunk
+    void* allocate(size_t size, size_t alignment)
+    {
+        if (size > CHUNK_SIZE)
+        {
+            throw bad_alloc();
+        }
+        uintptr_t aligned = ((uintptr_t)cursor + alignment - 1) / alignment * alignment;
+        if (aligned + size > (uintptr_t)limit)
+        {
+            Chunk* chunk = new Chunk;    // memory left uninitialized
+            chunk->previous = lastChunk;
+            lastChunk = chunk;
+            ++chunkAllocations;
+            cursor = lastChunk->memory;
+            limit = cursor + CHUNK_SIZE;
+            aligned = ((uintptr_t)cursor + alignment - 1) / alignment * alignment;
+        }
+        cursor = (char*)aligned + size;
+        return (void*)aligned;
+    }
+
+    // Whether memory comes from this arena
+    bool contains(const void* memory) const
+    {
+        const char* address = (const char*)memory;
+        if (address >= inlineBlock && address < inlineBlock + INLINE_SIZE)
+        {
+            return true;
+        }
+        for (const Chunk* chunk = lastChunk; chunk; chunk = chunk->previous)
+        {
+            if (address >= chunk->memory && address < chunk->memory + CHUNK_SIZE)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Construct a pizza or a topping in the arena: arena.make<Onion>(arena.make<Marghrita>())
+    // A topping must wrap a pizza of this arena (invalid_argument otherwise) and does not own it
+    template<typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(!is_same<T, FrozenPizza>::value, "FrozenPizza owns a vector, it cannot live in an OrderArena");
+        static_assert(alignof(T) <= alignof(max_align_t), "over-aligned type");
+        T* object = new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+        if constexpr (is_base_of<ToppingDecorator, T>::value)
+        {
+            object->ownsPizza = false;
+            if (!contains(object->basepizza))
+            {
+                throw invalid_argument("OrderArena: a topping must wrap a pizza from the same arena");
+            }
+        }
+        return object;
+    }
+
+    // Free every pizza of the order in one go, the inline block is reused by the next order
+    void reset()
+    {
+        while (lastChunk)
+        {
+            Chunk* previous = lastChunk->previous;
+            delete lastChunk;
+            lastChunk = previous;
+        }
+        cursor = inlineBlock;
+        limit = inlineBlock + INLINE_SIZE;
+    }
+
+    // Heap allocations made by the arena so far (its chunks)
+    unsigned long long heapAllocations() const
+    {
+        return chunkAllocations;
+    }
+};
+
+// Random decorator chain on the heap, deleting the returned pizza deletes every layer
+BasePizza* randomPizza(mt19937& random, int maxToppings)
+{
+    int kind = (int)(random() % 3);
+    BasePizza* pizza = kind == 0 ? (BasePizza*)new Farmhouse() : kind == 1 ? (BasePizza*)new Marghrita()
+                                                                          : (BasePizza*)new vegDelight();
+    int toppings = (int)(random() % (maxToppings + 1));
+    for (int t = 0; t < toppings; ++t)
+    {
+        int which = (int)(random() % 3);
+        pizza = which == 0 ? (BasePizza*)new ExtraCheese(pizza) : which == 1 ? (BasePizza*)new Mushroom(pizza)
+                                                                             : (BasePizza*)new Onion(pizza);
+    }
+    return pizza;
+}
+
+// Batch pricing must give the same totals as cost() of the decorator classes, before and after a price change
+bool runCartCheck()
+{
+    mt19937 random(11);
+    vector<BasePizza*> pizzas;
+    PizzaCart cart;
+    for (int p = 0; p < 5003; ++p)
+    {
+        pizzas.push_back(randomPizza(random, 8));
+        cart.add(pizzas.back());
+    }
+    // bitset rows too: Marghrita with cheese and onion, Farmhouse plain
+    BasePizza* onion = new Onion(new ExtraCheese(new Marghrita()));
+    BasePizza* farmhouse = new Farmhouse();
+    pizzas.push_back(onion);
+    cart.addToppingBits(PizzaBase::Marghrita, (1u << (int)Topping::ExtraCheese) | (1u << (int)Topping::Onion));
+    pizzas.push_back(farmhouse);
+    cart.addToppingBits(PizzaBase::Farmhouse, 0);
+    // compile-time menu items, priced from the table once it changes like every other pizza
+    pizzas.push_back(new CheeseMarghrita());
+    pizzas.push_back(new CheeseMushroomMarghrita());
+    pizzas.push_back(new LoadedVegDelight());
+    for (size_t i = pizzas.size() - 3; i < pizzas.size(); ++i)
+    {
+        cart.add(pizzas[i]);
+    }
+
+    // Every round changes prices, then cost(), the cart and the records frozen in this and every earlier
+    // round must agree
+    bool ok = true;
+    PriceTable& prices = PriceTable::current();
+    vector<vector<FrozenPizza>> frozen;
+    for (int round = 0; round < 3 && ok; ++round)
+    {
+        if (round == 1)
+        {
+            prices.setPrice(Topping::Mushroom, 17);
+            prices.setPrice(PizzaBase::Farmhouse, 210);
+        }
+        if (round == 2)
+        {
+            prices.setPrice(Topping::ExtraCheese, 25);
+        }
+        frozen.emplace_back();
+        frozen.back().reserve(pizzas.size());
+        for (BasePizza* pizza : pizzas)
+        {
+            frozen.back().emplace_back(pizza);
+        }
+        vector<int> scalar;
+        vector<int> vectorized;
+        priceCart(cart, scalar, &priceCartScalar);
+        priceCart(cart, vectorized);
+        for (size_t i = 0; i < pizzas.size() && ok; ++i)
+        {
+            int expected = pizzas[i]->cost();
+            if (scalar[i] != expected || vectorized[i] != expected)
+            {
+                cout << "FAILED: pizza " << i << " costs " << expected << ", cart says " << scalar[i] << " (scalar) and "
+                     << vectorized[i] << " (" << cartKernel().name << ")" << endl;
+                ok = false;
+            }
+            for (size_t f = 0; f < frozen.size() && ok; ++f)
+            {
+                if (frozen[f][i].cost() != expected)
+                {
+                    cout << "FAILED: pizza " << i << " costs " << expected << ", frozen in round " << f << " it says "
+                         << frozen[f][i].cost() << endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+    prices.setPrice(Topping::Mushroom, PriceTable::defaultPrice(Topping::Mushroom));
+    prices.setPrice(PizzaBase::Farmhouse, PriceTable::defaultPrice(PizzaBase::Farmhouse));
+    prices.setPrice(Topping::ExtraCheese, PriceTable::defaultPrice(Topping::ExtraCheese));
+
+    // 256 extra cheeses do not fit into a count column: rejected, not wrapped to 0
+    BasePizza* cheesy = new Farmhouse();
+    for (int t = 0; t <= PizzaCart::MAX_COUNT; ++t)
+    {
+        cheesy = new ExtraCheese(cheesy);
+    }
+    size_t rows = cart.size();
+    bool rejected = false;
+    try
+    {
+        cart.add(cheesy);
+    }
+    catch (const out_of_range&)
+    {
+        rejected = true;
+    }
+    if (!rejected || cart.size() != rows)
+    {
+        cout << "FAILED: a pizza with 256 extra cheeses was " << (rejected ? "half added" : "accepted") << endl;
+        ok = false;
+    }
+    delete cheesy;
+
+    for (BasePizza* pizza : pizzas)
+    {
+        delete pizza;
+    }
+    cout << "cart check (" << cartKernel().name << " kernel): " << (ok ? "passed" : "FAILED") << endl;
+    return ok;
+}
+
+// Carts of 5000 pizzas priced right after a price change: walking the chains vs the batch kernels
+void runCartBenchmark()
+{
+    const int cartSize = 5000;
+    const int rounds = 200;
+    mt19937 random(5);
+    vector<BasePizza*> pizzas;
+    PizzaCart cart;
+    for (int p = 0; p < cartSize; ++p)
+    {
+        pizzas.push_back(randomPizza(random, 6));
+        cart.add(pizzas.back());
+    }
+
+    PriceTable& prices = PriceTable::current();
+    auto report = [&](const char* label, auto priceOnce)
+    {
+        long long sum = 0;
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+        {
+            prices.setPrice(Topping::Onion, prices.price(Topping::Onion));    // new version, caches stale
+            sum += priceOnce();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << label << (long long)((double)rounds * cartSize / seconds) << " pizzas/sec" << endl;
+        return sum;
+    };
+
+    vector<int> totals;
+    long long chainSum = report("decorator chains: ", [&]
+    {
+        long long sum = 0;
+        for (BasePizza* pizza : pizzas)
+        {
+            sum += pizza->cost();
+        }
+        return sum;
+    });
+    long long scalarSum = report("cart, scalar:     ", [&] { return priceCart(cart, totals, &priceCartScalar); });
+    long long batchSum = scalarSum;
+    if (cartKernel().kernel != &priceCartScalar)
+    {
+        batchSum = report("cart, avx2:       ", [&] { return priceCart(cart, totals); });
+    }
+    if (chainSum != scalarSum || scalarSum != batchSum)
+    {
+        cout << "(mismatch!)" << endl;
+    }
+
+    for (BasePizza* pizza : pizzas)
+    {
+        delete pizza;
+    }
+}
+
+// cost() of a decorator chain vs its frozen record, 1 to 64 toppings
+void runFreezeBenchmark()
+{
+    const int pizzas = 1000;
+    for (int depth = 1; depth <= 64; depth *= 2)
+    {
+        vector<BasePizza*> chains;
+        vector<BasePizza*> frozen;
+        for (int p = 0; p < pizzas; ++p)
+        {
+            BasePizza* pizza = p % 3 == 0 ? (BasePizza*)new Farmhouse() : p % 3 == 1 ? (BasePizza*)new Marghrita()
+                                                                               : (BasePizza*)new vegDelight();
+            for (int t = 0; t < depth; ++t)
+            {
+                int which = (p + t) % 3;
+                pizza = which == 0 ? (BasePizza*)new ExtraCheese(pizza) : which == 1 ? (BasePizza*)new Mushroom(pizza)
+                                                                                     : (BasePizza*)new Onion(pizza);
+            }
+            chains.push_back(pizza);
+            frozen.push_back(new FrozenPizza(pizza));
+        }
+
+        // about 20M layers per measurement; "cold" changes a price before every round, so every cached
+        // cost is stale and the chains are walked, "warm" leaves the prices alone
+        const int rounds = max(1, 20000000 / (pizzas * depth));
+        PriceTable& prices = PriceTable::current();
+        auto time = [&](const vector<BasePizza*>& which, bool cold, long long& sum)
+        {
+            auto start = chrono::steady_clock::now();
+            for (int r = 0; r < rounds; ++r)
+            {
+                if (cold)
+                {
+                    prices.setPrice(Topping::Onion, prices.price(Topping::Onion));
+                }
+                for (BasePizza* pizza : which)
+                {
+                    sum += pizza->cost();
+                }
+            }
+            return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)rounds * pizzas);
+        };
+        long long chainSum = 0;
+        long long frozenSum = 0;
+        double chainCold = time(chains, true, chainSum);
+        double frozenCold = time(frozen, true, frozenSum);
+        double chainWarm = time(chains, false, chainSum);
+        double frozenWarm = time(frozen, false, frozenSum);
+        cout << depth << " toppings: cold chain " << chainCold << " ns, frozen " << frozenCold << " ns; warm chain "
+             << chainWarm << " ns, frozen " << frozenWarm << " ns per cost()" << (chainSum == frozenSum ? "" : " (mismatch!)")
+             << endl;
+
+        for (BasePizza* pizza : chains)
+        {
+            delete pizza;
+        }
+        for (BasePizza* pizza : frozen)
+        {
+            delete pizza;
+        }
+    }
+}
+
+// cost() through BasePizza* of the same menu item built at runtime (decorator chain, cached cost) and at
+// compile time (Decorated, the constant after a price table version check), and of the compile-time one
+// called on its own type, where only the version check is left in the loop
+void runComposeBenchmark()
+{
+    const int pizzas = 3000;
+    const int rounds = 5000;
+    vector<BasePizza*> runtime;
+    vector<BasePizza*> compiled;
+    for (int p = 0; p < pizzas; ++p)
+    {
+        runtime.push_back(new Onion(new Mushroom(new ExtraCheese(new vegDelight()))));
+        compiled.push_back(new LoadedVegDelight());
+    }
+
+    auto time = [&](const vector<BasePizza*>& which, long long& sum)
+    {
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+        {
+            for (BasePizza* pizza : which)
+            {
+                sum += pizza->cost();
+            }
+        }
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)rounds * pizzas);
+    };
+    long long runtimeSum = 0;
+    long long compiledSum = 0;
+    double runtimeNs = time(runtime, runtimeSum);
+    double compiledNs = time(compiled, compiledSum);
+
+    // known static type: no virtual call, the loop adds a constant while the prices are unchanged
+    long long staticSum = 0;
+    LoadedVegDelight menuItem;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int p = 0; p < pizzas; ++p)
+        {
+            staticSum += menuItem.cost();
+        }
+    }
+    double staticNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)rounds * pizzas);
+
+    cout << "vegDelight + 3 toppings: chain " << runtimeNs << " ns/cost(), Decorated via BasePizza* " << compiledNs
+         << " ns/cost(), Decorated direct " << staticNs << " ns/cost()"
+         << (runtimeSum == compiledSum && compiledSum == staticSum ? "" : " (mismatch!)") << endl;
+
+    for (BasePizza* pizza : runtime)
+    {
+        delete pizza;
+    }
+    for (BasePizza* pizza : compiled)
+    {
+        delete pizza;
+    }
+}
+
+// One pizza of an order: base and toppings (innermost first)
+struct PizzaRecipe
+{
+    PizzaBase base;
+    vector<Topping> toppings;
+};
+
+// Build a recipe with new (arena == nullptr) or in an arena; every new adds one to heapAllocations (the arena
+// counts its own chunks)
+BasePizza* buildPizza(const PizzaRecipe& recipe, OrderArena* arena, unsigned long long& heapAllocations)
+{
+    auto make = [arena, &heapAllocations](auto* type, auto... args) -> BasePizza*
+    {
+        typedef typename remove_pointer<decltype(type)>::type T;
+        if (arena)
+        {
+            return arena->make<T>(args...);
+        }
+        ++heapAllocations;
+        return new T(args...);
+    };
+    BasePizza* pizza = recipe.base == PizzaBase::Farmhouse ? make((Farmhouse*)nullptr)
+                     : recipe.base == PizzaBase::Marghrita ? make((Marghrita*)nullptr) : make((vegDelight*)nullptr);
+    for (Topping topping : recipe.toppings)
+    {
+        pizza = topping == Topping::ExtraCheese ? make((ExtraCheese*)nullptr, pizza)
+              : topping == Topping::Mushroom ? make((Mushroom*)nullptr, pizza) : make((Onion*)nullptr, pizza);
+    }
+    return pizza;
+}
+
+// Orders of 8 pizzas with 0 to 6 toppings: built with new and freed by deleting each pizza, vs built in an
+// OrderArena and freed with it
+void runOrderBenchmark()
+{
+    const int orders = 100000;
+    const int pizzasPerOrder = 8;
+    mt19937 random(3);
+    vector<PizzaRecipe> recipes(pizzasPerOrder * 64);
+    for (PizzaRecipe& recipe : recipes)
+    {
+        recipe.base = (PizzaBase)(random() % 3);
+        recipe.toppings.resize(random() % 7);
+        for (Topping& topping : recipe.toppings)
+        {
+            topping = (Topping)(random() % 3);
+        }
+    }
+
+    auto run = [&](const char* label, bool useArena)
+    {
+        long long sum = 0;
+        unsigned long long heapAllocations = 0;
+        auto start = chrono::steady_clock::now();
+        for (int o = 0; o < orders; ++o)
+        {
+            const PizzaRecipe* order = &recipes[(o % 64) * pizzasPerOrder];
+            BasePizza* pizzas[pizzasPerOrder];
+            if (useArena)
+            {
+                OrderArena arena;
+                for (int p = 0; p < pizzasPerOrder; ++p)
+                {
+                    pizzas[p] = buildPizza(order[p], &arena, heapAllocations);
+                    sum += pizzas[p]->cost();
+                }
+                heapAllocations += arena.heapAllocations();
+            }
+            else
+            {
+                for (int p = 0; p < pizzasPerOrder; ++p)
+                {
+                    pizzas[p] = buildPizza(order[p], nullptr, heapAllocations);
+                    sum += pizzas[p]->cost();
+                }
+                for (BasePizza* pizza : pizzas)
+                {
+                    delete pizza;
+                }
+            }
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / orders;
+        double allocations = (double)heapAllocations / orders;
+        cout << label << ns << " ns/order, " << allocations << " allocations/order" << endl;
+        return sum;
+    };
+    long long heapSum = run("new/delete: ", false);
+    long long arenaSum = run("arena:      ", true);
+    if (heapSum != arenaSum)
+    {
+        cout << "(mismatch!)" << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // ./a.out bench  -> run the benchmark instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runComposeBenchmark();    // first, while the menu prices are unchanged
+        runFreezeBenchmark();
+        runCartBenchmark();
+        runOrderBenchmark();
+        return 0;
+    }
+
+    // ./a.out check  -> compare batch cart pricing with the decorator classes
+    if (argc > 1 && string(argv[1]) == "check")
+    {
+        return runCartCheck() ? 0 : 1;
+    }
     // Create a Marghrita pizza with Extra Cheese
     BasePizza *pizza1 = new ExtraCheese(new Marghrita());
     cout << endl<<"Cost of Marghrita pizza with Extra Cheese: " << pizza1->cost() << endl;
@@ -250,10 +1258,35 @@ int main()
     BasePizza *pizza3 = new Onion(new Mushroom(new ExtraCheese(new vegDelight())));
     cout <<endl<< "Cost of vegDelight pizza with Extra Cheese, Mushroom, and Onion: " << pizza3->cost() << endl<<endl;;
 
+    // Freeze pizza3 into one record, its cost() no longer walks the chain
+    FrozenPizza frozen3(pizza3);
+    cout << "Cost of frozen pizza3 (" << frozen3.toppings.size() << " toppings): " << frozen3.cost() << endl << endl;
+
+    // Same pizza from the menu, composed at compile time and used through BasePizza*
+    BasePizza *menuPizza = new LoadedVegDelight();
+    cout << "Cost of menu vegDelight with Extra Cheese, Mushroom, and Onion: " << menuPizza->cost() << endl << endl;
+
+    // Extra cheese gets more expensive, every cached cost is recomputed on its next cost()
+    PriceTable::current().setPrice(Topping::ExtraCheese, 25);
+    cout << "After extra cheese went up to 25:" << endl;
+    cout << "Marghrita with Extra Cheese: " << pizza1->cost() << ", pizza3: " << pizza3->cost() << ", frozen pizza3: "
+         << frozen3.cost() << ", menu pizza: " << menuPizza->cost() << endl << endl;
+    delete menuPizza;
+
     // Clean up dynamically allocated objects to prevent memory leaks
+    // (each topping deletes the pizza it wraps, so this frees every layer)
     delete pizza1;
     delete pizza2;
     delete pizza3;
 
+    // An order built in an arena: no malloc per layer, freed in one go when the arena goes away
+    {
+        OrderArena order;
+        BasePizza *first = order.make<Onion>(order.make<ExtraCheese>(order.make<Farmhouse>()));
+        BasePizza *second = order.make<Mushroom>(order.make<Marghrita>());
+        cout << "Order from the arena: " << first->cost() << " + " << second->cost() << " = "
+             << first->cost() + second->cost() << endl << endl;
+    }
+
     return 0;
 }
@@ -3,11 +3,85 @@ when we need to create objects based on some condition like.. if condition 1 wil
                                                               if condition 2 will fulfill then i will create obj2 and so on..
 just to avoide duplication of code
 
+Registration based factory:-
+
+    ---> every shape registers a creator function at static-init time (ShapeRegistrar), so adding a shape
+         does not touch the factory.
+    ---> the built-in names are known at compile time; a constexpr perfect hash maps each of them to its own
+         slot, so a lookup is one hash and one string compare. Other names (plugins) go to a hash map.
+    ---> run "./a.out bench" to compare lookup cost at 3, 50 and 500 registered types.
+
+Pooled / arena allocation:-
+
+    ---> getPooledShape() takes the object from a per-type pool, the ShapeHandle (unique_ptr with ShapeDeleter)
+         gives it back when destroyed.
+    ---> getShape(name, arena) bump allocates in a ShapeArena, reset() frees the whole frame in O(1).
+
+Batch creation:-
+
+    ---> createBatch(name, count) appends count shapes to the factory's ShapeStore, which keeps one set of
+         columns (x, y) per concrete type instead of one heap object per shape.
+    ---> drawAll() / visitAll() walk the store type by type, contiguous memory and no virtual call per shape.
+
+Variant shapes:-
+
+    ---> getShapeValue(name) returns a ShapeValue (std::variant<Circle, Square, Rectangle>) that can be stored
+         by value in a vector and dispatched with std::visit; the shapes are final, so the compiler inlines.
+
+Geometry:-
+
+    ---> shapes have real dimensions (Circle radius, Square side, Rectangle width x height) and area(),
+         perimeter() and bounds().
+    ---> computeGeometry() runs a kernel over a batch's columns: AVX2 when the CPU has it (checked at runtime),
+         scalar otherwise. "./a.out check" compares the two, "./a.out bench" reports shapes/sec.
+
+compile:- g++ -std=c++17 -O2 factory_design_pattern.cpp
+
 */
 
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <variant>
+#include <optional>
+#include <random>
+#include <cmath>
+#include <functional>
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SHAPE_GEOMETRY_AVX2 1
+#endif
 using namespace std;
 
+// Closed set of built-in shapes
+enum class ShapeKind { Circle, Square, Rectangle };
+constexpr size_t SHAPE_KIND_COUNT = 3;
+
+constexpr float SHAPE_PI = 3.14159265358979f;
+
+// Axis-aligned bounding box
+struct ShapeBounds
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+};
+
 // Abstract base class Shape
 class Shape
 {
@@ -15,78 +89,1443 @@ class Shape
     
     // Pure virtual function to draw the shape
     virtual void draw() = 0;
+
+    // Pure virtual functions for the geometry of the shape
+    virtual float area() const = 0;
+    virtual float perimeter() const = 0;
+    virtual ShapeBounds bounds() const = 0;
     
     // Virtual destructor to ensure proper cleanup
     virtual ~Shape() {}
 };
 
+// Position of a built-in shape (its centre)
+// Not part of Shape, so plugin shapes keep whatever state they need; batches keep it in the ShapeStore columns
+struct ShapePosition
+{
+    float x = 0;
+    float y = 0;
+};
+
 // Concrete class Circle
-class Circle : public Shape
+class Circle final : public Shape, public ShapePosition
 {
     public:
-    
+
+    float radius;
+
+    // Constructor
+    explicit Circle(float radius = 1) : radius(radius)
+    {
+    }
+
     // Implementation of the draw() function for Circle
     void draw() override
     {
         cout << "Circle" << endl;
     }
+
+    // Geometry of the Circle
+    float area() const override
+    {
+        return SHAPE_PI * radius * radius;
+    }
+
+    float perimeter() const override
+    {
+        return 2 * SHAPE_PI * radius;
+    }
+
+    ShapeBounds bounds() const override
+    {
+        return ShapeBounds{ x - radius, y - radius, x + radius, y + radius };
+    }
 };
 
 // Concrete class Square
-class Square : public Shape
+class Square final : public Shape, public ShapePosition
 {
     public:
-    
+
+    float side;
+
+    // Constructor
+    explicit Square(float side = 1) : side(side)
+    {
+    }
+
     // Implementation of the draw() function for Square
     void draw() override
     {
         cout << "Square" << endl;
     }
+
+    // Geometry of the Square
+    float area() const override
+    {
+        return side * side;
+    }
+
+    float perimeter() const override
+    {
+        return 4 * side;
+    }
+
+    ShapeBounds bounds() const override
+    {
+        float half = side * 0.5f;
+        return ShapeBounds{ x - half, y - half, x + half, y + half };
+    }
 };
 
 // Concrete class Rectangle
-class Rectangle : public Shape
+class Rectangle final : public Shape, public ShapePosition
 {
     public:
-    
+
+    float width;
+    float height;
+
+    // Constructor
+    explicit Rectangle(float width = 2, float height = 1) : width(width), height(height)
+    {
+    }
+
     // Implementation of the draw() function for Rectangle
     void draw() override
     {
         cout << "Rectangle" << endl;
     }
+
+    // Geometry of the Rectangle
+    float area() const override
+    {
+        return width * height;
+    }
+
+    float perimeter() const override
+    {
+        return 2 * (width + height);
+    }
+
+    ShapeBounds bounds() const override
+    {
+        float halfWidth = width * 0.5f;
+        float halfHeight = height * 0.5f;
+        return ShapeBounds{ x - halfWidth, y - halfHeight, x + halfWidth, y + halfHeight };
+    }
 };
 
+// Position of a built-in shape behind a Shape*, the caller knows which kind it made
+inline ShapePosition& builtInPosition(Shape* shape, ShapeKind kind)
+{
+    switch (kind)
+    {
+    case ShapeKind::Circle:
+        return *static_cast<Circle*>(shape);
+    case ShapeKind::Square:
+        return *static_cast<Square*>(shape);
+    default:
+        return *static_cast<Rectangle*>(shape);
+    }
+}
+
 // *********************** below code will also work **********************
 
+// Creator function registered for a shape name
+typedef Shape* (*ShapeCreator)();
+
+// Hash of the length and the first, middle and last character (like gperf), usable at compile time
+// The known names must differ in one of these, otherwise findPerfectSeed() never finishes (compile error)
+constexpr uint32_t shapeNameHash(string_view name, uint32_t seed)
+{
+    if (name.empty())
+    {
+        return seed;
+    }
+    uint32_t hash = (2166136261u ^ seed) * 16777619u ^ (uint32_t)name.size();
+    hash = (hash ^ (unsigned char)name[0]) * 16777619u;
+    hash = (hash ^ (unsigned char)name[name.size() / 2]) * 16777619u;
+    hash = (hash ^ (unsigned char)name[name.size() - 1]) * 16777619u;
+    return hash ^ (hash >> 15);
+}
+
+// Names known at compile time, they get a perfect hash slot
+constexpr string_view knownShapeNames[] = { "Circle", "Square", "Rectangle" };
+constexpr size_t KNOWN_SHAPE_COUNT = sizeof(knownShapeNames) / sizeof(knownShapeNames[0]);
+
+// Table size: next power of two at or above the number of known names
+constexpr size_t knownShapeTableSize()
+{
+    size_t size = 1;
+    while (size < KNOWN_SHAPE_COUNT)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+constexpr size_t KNOWN_SHAPE_TABLE_SIZE = knownShapeTableSize();
+
+// First seed for which every known name lands in its own slot
+constexpr uint32_t findPerfectSeed()
+{
+    for (uint32_t seed = 0;; ++seed)
+    {
+        bool used[KNOWN_SHAPE_TABLE_SIZE] = {};
+        bool collision = false;
+        for (size_t i = 0; i < KNOWN_SHAPE_COUNT && !collision; ++i)
+        {
+            size_t slot = shapeNameHash(knownShapeNames[i], seed) & (KNOWN_SHAPE_TABLE_SIZE - 1);
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if (!collision)
+        {
+            return seed;
+        }
+    }
+}
+constexpr uint32_t PERFECT_SEED = findPerfectSeed();
+
+// Perfect hash slot of a name (only meaningful for known names)
+constexpr size_t knownShapeSlot(string_view name)
+{
+    return shapeNameHash(name, PERFECT_SEED) & (KNOWN_SHAPE_TABLE_SIZE - 1);
+}
+
+// Every known name has a slot of its own
+constexpr bool knownShapeSlotsDistinct()
+{
+    for (size_t i = 0; i < KNOWN_SHAPE_COUNT; ++i)
+    {
+        for (size_t j = i + 1; j < KNOWN_SHAPE_COUNT; ++j)
+        {
+            if (knownShapeSlot(knownShapeNames[i]) == knownShapeSlot(knownShapeNames[j]))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(knownShapeSlotsDistinct(), "perfect hash must not collide");
+
+// Fixed-size blocks for one shape type, freed blocks go to a free list and are reused
+// Not thread-safe: one render thread creates and destroys the shapes
+class ShapePool
+{
+    static const size_t BLOCKS_PER_CHUNK = 1024;
+
+    size_t blockSize;
+    vector<char*> chunks;
+    void* freeList;
+
+    // Add a chunk of blocks to the free list
+    void grow()
+    {
+        char* chunk = new char[blockSize * BLOCKS_PER_CHUNK];
+        chunks.push_back(chunk);
+        for (size_t i = BLOCKS_PER_CHUNK; i-- > 0;)
+        {
+            void* block = chunk + i * blockSize;
+            *(void**)block = freeList;
+            freeList = block;
+        }
+    }
+
+    public:
+
+    // Constructor
+    ShapePool(size_t size, size_t alignment) : freeList(nullptr)
+    {
+        size = max(size, sizeof(void*));
+        blockSize = (size + alignment - 1) / alignment * alignment;
+    }
+
+    // Destructor
+    ~ShapePool()
+    {
+        for (char* chunk : chunks)
+        {
+            delete[] chunk;
+        }
+    }
+
+    // Take a block
+    void* allocate()
+    {
+        if (freeList == nullptr)
+        {
+            grow();
+        }
+        void* block = freeList;
+        freeList = *(void**)block;
+        return block;
+    }
+
+    // Give a block back
+    void release(void* block)
+    {
+        *(void**)block = freeList;
+        freeList = block;
+    }
+};
+
+// Memory for one frame of shapes: bump allocation, everything freed at once by reset()
+// reset() does not run destructors, so only shapes that own nothing else belong here (Circle, Square and Rectangle do)
+class ShapeArena
+{
+    static const size_t CHUNK_SIZE = 1 << 16;
+
+    vector<char*> chunks;
+    size_t current;
+    size_t used;
+
+    public:
+
+    // Constructor
+    ShapeArena() : current(0), used(0) {}
+
+    // Destructor
+    ~ShapeArena()
+    {
+        for (char* chunk : chunks)
+        {
+            delete[] chunk;
+        }
+    }
+
+    ShapeArena(const ShapeArena&) = delete;
+    ShapeArena& operator=(const ShapeArena&) = delete;
+
+    // Bump allocate, nullptr if the object does not fit into a chunk
+    void* allocate(size_t size, size_t alignment)
+    {
+        if (size > CHUNK_SIZE)
+        {
+            return nullptr;
+        }
+        size_t offset = (used + alignment - 1) / alignment * alignment;
+        if (chunks.empty() || offset + size > CHUNK_SIZE)
+        {
+            if (!chunks.empty())
+            {
+                ++current;
+            }
+            if (current == chunks.size())
+            {
+                chunks.push_back(new char[CHUNK_SIZE]);
+            }
+            offset = 0;
+        }
+        used = offset + size;
+        return chunks[current] + offset;
+    }
+
+    // Free the whole frame in O(1), the chunks are kept for the next frame
+    void reset()
+    {
+        current = 0;
+        used = 0;
+    }
+
+    // Bytes held by the arena
+    size_t capacityBytes() const
+    {
+        return chunks.size() * CHUNK_SIZE;
+    }
+};
+
+// Deleter of ShapeHandle, knows where the shape's memory came from
+struct ShapeDeleter
+{
+    enum Source { HEAP, POOL, ARENA };
+
+    Source source = HEAP;
+    ShapePool* pool = nullptr;
+
+    void operator()(Shape* shape) const
+    {
+        if (source == HEAP)
+        {
+            delete shape;
+        }
+        else if (source == POOL)
+        {
+            void* block = dynamic_cast<void*>(shape);
+            shape->~Shape();
+            pool->release(block);
+        }
+        // ARENA: nothing to do, the frame's reset() frees the memory
+    }
+};
+
+// Owning pointer to a factory-made shape
+typedef unique_ptr<Shape, ShapeDeleter> ShapeHandle;
+
+// Everything the factory knows about a registered shape type
+struct ShapeType
+{
+    ShapeCreator create;                    // new T()
+    Shape* (*construct)(void* memory);      // new (memory) T()
+    size_t size;
+    size_t alignment;
+    ShapePool* pool;                        // per-type pool
+};
+
+// Shapes created in batches, stored as struct-of-arrays: one set of columns per concrete type,
+// so a pass over all shapes of a type walks contiguous memory and needs no virtual call
+class ShapeStore
+{
+    public:
+
+    // Columns of one concrete type
+    // width and height are the extents of the shape (a Circle's diameter, a Square's side twice)
+    struct Columns
+    {
+        vector<float> x;
+        vector<float> y;
+        vector<float> width;
+        vector<float> height;
+
+        size_t size() const
+        {
+            return x.size();
+        }
+    };
+
+    private:
+
+    Columns columns[SHAPE_KIND_COUNT];
+
+    // Extents of a default-constructed shape of a kind, so a batch matches getShape() of the same name
+    static ShapeBounds defaultBounds(ShapeKind kind)
+    {
+        switch (kind)
+        {
+        case ShapeKind::Circle:
+            return Circle().bounds();
+        case ShapeKind::Square:
+            return Square().bounds();
+        case ShapeKind::Rectangle:
+            return Rectangle().bounds();
+        }
+        return ShapeBounds{ 0, 0, 0, 0 };
+    }
+
+    public:
+
+    // Append count default shapes of a kind (at the origin, default size), returns the index of the first
+    size_t append(ShapeKind kind, size_t count)
+    {
+        Columns& target = columns[(size_t)kind];
+        size_t first = target.size();
+        ShapeBounds bounds = defaultBounds(kind);
+        target.x.resize(first + count, 0.0f);
+        target.y.resize(first + count, 0.0f);
+        target.width.resize(first + count, bounds.maxX - bounds.minX);
+        target.height.resize(first + count, bounds.maxY - bounds.minY);
+        return first;
+    }
+
+    // Columns of a kind
+    Columns& of(ShapeKind kind)
+    {
+        return columns[(size_t)kind];
+    }
+
+    const Columns& of(ShapeKind kind) const
+    {
+        return columns[(size_t)kind];
+    }
+
+    // Call visitor(kind, index, x, y) for every shape, type by type
+    template<typename Visitor>
+    void visitAll(Visitor visitor) const
+    {
+        for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+        {
+            const Columns& current = columns[k];
+            const float* xs = current.x.data();
+            const float* ys = current.y.data();
+            for (size_t i = 0, n = current.size(); i < n; ++i)
+            {
+                visitor((ShapeKind)k, i, xs[i], ys[i]);
+            }
+        }
+    }
+
+    // Drop every shape
+    void clear()
+    {
+        for (Columns& current : columns)
+        {
+            current.x.clear();
+            current.y.clear();
+            current.width.clear();
+            current.height.clear();
+        }
+    }
+
+    // Number of shapes
+    size_t size() const
+    {
+        return columns[0].size() + columns[1].size() + columns[2].size();
+    }
+};
+
+// Geometry kernels over struct-of-arrays columns: every built-in shape is described by its centre and
+// extents, so one kernel serves all kinds, only two constants differ
+// (area = areaScale * width * height, perimeter = perimeterScale * (width + height))
+struct GeometryInput
+{
+    const float* x;
+    const float* y;
+    const float* width;
+    const float* height;
+};
+
+struct GeometryOutput
+{
+    float* area;
+    float* perimeter;
+    float* minX;
+    float* minY;
+    float* maxX;
+    float* maxY;
+};
+
+// Kernel computing shapes [first, last) of one kind
+typedef void (*GeometryKernel)(ShapeKind kind, const GeometryInput& in, const GeometryOutput& out, size_t first, size_t last);
+
+inline float geometryAreaScale(ShapeKind kind)
+{
+    return kind == ShapeKind::Circle ? SHAPE_PI / 4 : 1.0f;
+}
+
+inline float geometryPerimeterScale(ShapeKind kind)
+{
+    return kind == ShapeKind::Circle ? SHAPE_PI / 2 : 2.0f;
+}
+
+// Portable kernel, also the reference for the vectorized one
+void computeGeometryScalar(ShapeKind kind, const GeometryInput& in, const GeometryOutput& out, size_t first, size_t last)
+{
+    const float areaScale = geometryAreaScale(kind);
+    const float perimeterScale = geometryPerimeterScale(kind);
+    for (size_t i = first; i < last; ++i)
+    {
+        float width = in.width[i];
+        float height = in.height[i];
+        float halfWidth = width * 0.5f;
+        float halfHeight = height * 0.5f;
+        out.area[i] = areaScale * width * height;
+        out.perimeter[i] = perimeterScale * (width + height);
+        out.minX[i] = in.x[i] - halfWidth;
+        out.minY[i] = in.y[i] - halfHeight;
+        out.maxX[i] = in.x[i] + halfWidth;
+        out.maxY[i] = in.y[i] + halfHeight;
+    }
+}
+
+#ifdef SHAPE_GEOMETRY_AVX2
+// 8 shapes per step, same operations in the same order as the scalar kernel (no FMA), so the results
+// are bit-identical; the tail goes to the scalar kernel
+__attribute__((target("avx2")))
+void computeGeometryAvx2(ShapeKind kind, const GeometryInput& in, const GeometryOutput& out, size_t first, size_t last)
+{
+    const __m256 areaScale = _mm256_set1_ps(geometryAreaScale(kind));
+    const __m256 perimeterScale = _mm256_set1_ps(geometryPerimeterScale(kind));
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = first;
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256 width = _mm256_loadu_ps(in.width + i);
+        __m256 height = _mm256_loadu_ps(in.height + i);
+        __m256 x = _mm256_loadu_ps(in.x + i);
+        __m256 y = _mm256_loadu_ps(in.y + i);
+        __m256 halfWidth = _mm256_mul_ps(width, half);
+        __m256 halfHeight = _mm256_mul_ps(height, half);
+        _mm256_storeu_ps(out.area + i, _mm256_mul_ps(_mm256_mul_ps(areaScale, width), height));
+        _mm256_storeu_ps(out.perimeter + i, _mm256_mul_ps(perimeterScale, _mm256_add_ps(width, height)));
+        _mm256_storeu_ps(out.minX + i, _mm256_sub_ps(x, halfWidth));
+        _mm256_storeu_ps(out.minY + i, _mm256_sub_ps(y, halfHeight));
+        _mm256_storeu_ps(out.maxX + i, _mm256_add_ps(x, halfWidth));
+        _mm256_storeu_ps(out.maxY + i, _mm256_add_ps(y, halfHeight));
+    }
+    computeGeometryScalar(kind, in, out, i, last);
+}
+#endif
+
+// Kernel for this CPU, chosen once at first use
+struct GeometryKernelChoice
+{
+    GeometryKernel kernel;
+    const char* name;
+};
+
+GeometryKernelChoice selectGeometryKernel()
+{
+#ifdef SHAPE_GEOMETRY_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return GeometryKernelChoice{ &computeGeometryAvx2, "avx2" };
+    }
+#endif
+    return GeometryKernelChoice{ &computeGeometryScalar, "scalar" };
+}
+
+const GeometryKernelChoice& geometryKernel()
+{
+    static const GeometryKernelChoice choice = selectGeometryKernel();
+    return choice;
+}
+
+// Area, perimeter and bounding box of a batch of shapes, one column each
+struct ShapeGeometry
+{
+    vector<float> area;
+    vector<float> perimeter;
+    vector<float> minX;
+    vector<float> minY;
+    vector<float> maxX;
+    vector<float> maxY;
+
+    void resize(size_t count)
+    {
+        area.resize(count);
+        perimeter.resize(count);
+        minX.resize(count);
+        minY.resize(count);
+        maxX.resize(count);
+        maxY.resize(count);
+    }
+
+    GeometryOutput output()
+    {
+        return GeometryOutput{ area.data(), perimeter.data(), minX.data(), minY.data(), maxX.data(), maxY.data() };
+    }
+};
+
+// Geometry of every shape in the columns, with a given kernel
+inline void computeGeometry(ShapeKind kind, const ShapeStore::Columns& columns, ShapeGeometry& out, GeometryKernel kernel)
+{
+    out.resize(columns.size());
+    GeometryInput in{ columns.x.data(), columns.y.data(), columns.width.data(), columns.height.data() };
+    kernel(kind, in, out.output(), 0, columns.size());
+}
+
+// A built-in shape held by value: a closed set, so std::visit dispatches with a jump table
+// and, the classes being final, the calls inside the visitor are direct and can be inlined
+typedef variant<Circle, Square, Rectangle> ShapeValue;
+
+// Range of shapes made by one createBatch() call
+struct ShapeBatch
+{
+    ShapeKind kind;
+    size_t first;
+    size_t count;
+};
+
 // Shape Factory class
 class ShapeFactory
 {
+    // Types of the known names, by perfect hash slot
+    struct KnownSlot
+    {
+        string_view name;
+        ShapeType type;
+    };
+
+    // Registered types (function-local statics, so registration order at static-init time does not matter)
+    static KnownSlot* knownSlots()
+    {
+        static KnownSlot slots[KNOWN_SHAPE_TABLE_SIZE] = {};
+        return slots;
+    }
+
+    // Plugin names are kept in a list (stable addresses) and the map holds views of them
+    static unordered_map<string_view, ShapeType>& pluginTypes()
+    {
+        static unordered_map<string_view, ShapeType> types;
+        return types;
+    }
+
+    static list<string>& pluginNames()
+    {
+        static list<string> names;
+        return names;
+    }
+
+    // Index of the name in knownShapeNames, KNOWN_SHAPE_COUNT if it is not a compile-time known name
+    static size_t knownIndex(string_view name)
+    {
+        for (size_t i = 0; i < KNOWN_SHAPE_COUNT; ++i)
+        {
+            if (knownShapeNames[i] == name)
+            {
+                return i;
+            }
+        }
+        return KNOWN_SHAPE_COUNT;
+    }
+
+    // Struct-of-arrays store of batch-created shapes
+    ShapeStore store;
+
     public:
-    
+
+    // Register a type, known names go to their perfect hash slot, others to the plugin map
+    // The name is copied (or is one of the static known names), so a temporary string is fine
+    static void registerShape(string_view name, const ShapeType& type)
+    {
+        size_t known = knownIndex(name);
+        if (known < KNOWN_SHAPE_COUNT)
+        {
+            knownSlots()[knownShapeSlot(name)] = KnownSlot{ knownShapeNames[known], type };
+        }
+        else
+        {
+            auto it = pluginTypes().find(name);
+            if (it != pluginTypes().end())
+            {
+                it->second = type;
+                return;
+            }
+            pluginNames().emplace_back(name);
+            pluginTypes()[pluginNames().back()] = type;
+        }
+    }
+
+    // Type registered under a name, nullptr if none
+    static const ShapeType* findType(string_view name)
+    {
+        const KnownSlot& slot = knownSlots()[knownShapeSlot(name)];
+        if (slot.type.create != nullptr && slot.name == name)
+        {
+            return &slot.type;
+        }
+
+        unordered_map<string_view, ShapeType>& plugins = pluginTypes();
+        if (plugins.empty())
+        {
+            return nullptr;
+        }
+        auto it = plugins.find(name);
+        return it == plugins.end() ? nullptr : &it->second;
+    }
+
+    // Creator of a name, nullptr if nothing is registered under it
+    static ShapeCreator findCreator(string_view name)
+    {
+        const ShapeType* type = findType(name);
+        return type == nullptr ? nullptr : type->create;
+    }
+
     // Method to create shapes based on input string
     Shape* getShape(const string &input)
     {
-        if (input == "Circle")
+        ShapeCreator creator = findCreator(input);
+        return creator == nullptr ? nullptr : creator();
+    }
+
+    // Kind of a built-in name, false for plugins (they have no batch storage)
+    static bool builtInKind(string_view name, ShapeKind& kind)
+    {
+        static const ShapeKind kinds[] = { ShapeKind::Circle, ShapeKind::Square, ShapeKind::Rectangle };
+        for (size_t i = 0; i < KNOWN_SHAPE_COUNT; ++i)
         {
-            return new Circle();
+            if (knownShapeNames[i] == name)
+            {
+                kind = kinds[i];
+                return true;
+            }
         }
-        else if (input == "Square")
+        return false;
+    }
+
+    // Create a built-in shape by value (no heap, no vtable dispatch), nothing for unknown or plugin types
+    static optional<ShapeValue> getShapeValue(string_view input)
+    {
+        ShapeKind kind;
+        if (!builtInKind(input, kind))
         {
-            return new Square();
+            return nullopt;
         }
-        else if (input == "Rectangle")
+        switch (kind)
         {
-            return new Rectangle();
+        case ShapeKind::Circle:
+            return ShapeValue(in_place_type<Circle>);
+        case ShapeKind::Square:
+            return ShapeValue(in_place_type<Square>);
+        case ShapeKind::Rectangle:
+            return ShapeValue(in_place_type<Rectangle>);
         }
-        else
+        return nullopt;
+    }
+
+    // Create count shapes of a built-in type in the factory's struct-of-arrays store
+    // Returns an empty batch for unknown or plugin types
+    ShapeBatch createBatch(string_view input, size_t count)
+    {
+        ShapeKind kind;
+        if (!builtInKind(input, kind))
         {
-            return nullptr;
+            return ShapeBatch{ ShapeKind::Circle, 0, 0 };
+        }
+        return ShapeBatch{ kind, store.append(kind, count), count };
+    }
+
+    // Columns of the batch-created shapes of a kind (to set positions)
+    ShapeStore::Columns& batchColumns(ShapeKind kind)
+    {
+        return store.of(kind);
+    }
+
+    // Call visitor(kind, index, x, y) for every batch-created shape, type by type
+    template<typename Visitor>
+    void visitAll(Visitor visitor) const
+    {
+        store.visitAll(visitor);
+    }
+
+    // Area, perimeter and bounds of every batch-created shape of a kind, with the best kernel for this CPU
+    void computeGeometry(ShapeKind kind, ShapeGeometry& out) const
+    {
+        ::computeGeometry(kind, store.of(kind), out, geometryKernel().kernel);
+    }
+
+    // Draw every batch-created shape, type by type
+    void drawAll(ostream& out = cout) const
+    {
+        static const char* const names[] = { "Circle\n", "Square\n", "Rectangle\n" };
+        store.visitAll([&out](ShapeKind kind, size_t, float, float)
+        {
+            out << names[(size_t)kind];
+        });
+        out.flush();
+    }
+
+    // Drop every batch-created shape
+    void clearBatches()
+    {
+        store.clear();
+    }
+
+    // Create a shape from its type's pool, the handle gives the block back
+    ShapeHandle getPooledShape(string_view input)
+    {
+        const ShapeType* type = findType(input);
+        if (type == nullptr)
+        {
+            return ShapeHandle();
+        }
+        ShapeDeleter deleter;
+        deleter.source = ShapeDeleter::POOL;
+        deleter.pool = type->pool;
+        return ShapeHandle(type->construct(type->pool->allocate()), deleter);
+    }
+
+    // Create a shape in a frame arena, the handle frees nothing: arena.reset() frees the frame
+    ShapeHandle getShape(string_view input, ShapeArena& arena)
+    {
+        const ShapeType* type = findType(input);
+        void* memory = type == nullptr ? nullptr : arena.allocate(type->size, type->alignment);
+        if (memory == nullptr)
+        {
+            return ShapeHandle();
         }
+        ShapeDeleter deleter;
+        deleter.source = ShapeDeleter::ARENA;
+        return ShapeHandle(type->construct(memory), deleter);
     }
 };
 
-int main()
+// Registers T under a name when constructed (declare one as a static object)
+template<typename T>
+struct ShapeRegistrar
+{
+    // Creator for T
+    static Shape* create()
+    {
+        return new T();
+    }
+
+    // Construct T in given memory
+    static Shape* construct(void* memory)
+    {
+        return new (memory) T();
+    }
+
+    // Pool of T blocks
+    static ShapePool* pool()
+    {
+        static ShapePool blocks(sizeof(T), alignof(T));
+        return &blocks;
+    }
+
+    // Everything the factory needs for T
+    static ShapeType type()
+    {
+        return ShapeType{ &create, &construct, sizeof(T), alignof(T), pool() };
+    }
+
+    // Constructor
+    ShapeRegistrar(string_view name)
+    {
+        ShapeFactory::registerShape(name, type());
+    }
+};
+
+// Self-registration of the built-in shapes at static-init time
+static ShapeRegistrar<Circle> circleRegistrar("Circle");
+static ShapeRegistrar<Square> squareRegistrar("Square");
+static ShapeRegistrar<Rectangle> rectangleRegistrar("Rectangle");
+
+// Lookup cost with 3, 50 and 500 registered types: if-chain style linear search vs the factory
+// Extra types are registered as plugins, so 50 and 500 also exercise the fallback map
+void runLookupBenchmark()
+{
+    const int lookups = 2000000;
+    int registered = 3;
+
+    for (int types : {3, 50, 500})
+    {
+        // plugin types up to the wanted count
+        for (; registered < types; ++registered)
+        {
+            ShapeFactory::registerShape("PluginShape" + to_string(registered), ShapeRegistrar<Circle>::type());
+        }
+
+        // the same names in a list, searched like the old chain of string compares
+        vector<pair<string, ShapeCreator>> chain;
+        for (string_view known : knownShapeNames)
+        {
+            chain.emplace_back(string(known), ShapeFactory::findCreator(known));
+        }
+        for (int i = 3; i < types; ++i)
+        {
+            string name = "PluginShape" + to_string(i);
+            chain.emplace_back(name, ShapeFactory::findCreator(name));
+        }
+
+        // look up every registered name in turn
+        vector<string> queries;
+        for (auto& entry : chain)
+        {
+            queries.push_back(entry.first);
+        }
+
+        uintptr_t checksum = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i)
+        {
+            const string& query = queries[i % queries.size()];
+            for (auto& entry : chain)
+            {
+                if (entry.first == query)
+                {
+                    checksum += (uintptr_t)entry.second;
+                    break;
+                }
+            }
+        }
+        auto middle = chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i)
+        {
+            checksum -= (uintptr_t)ShapeFactory::findCreator(queries[i % queries.size()]);
+        }
+        auto end = chrono::steady_clock::now();
+
+        cout << types << " types: if-chain " << chrono::duration<double, nano>(middle - start).count() / lookups
+             << " ns/lookup, factory " << chrono::duration<double, nano>(end - middle).count() / lookups << " ns/lookup"
+             << (checksum == 0 ? "" : " (mismatch!)") << endl;
+
+        // known names alone, the perfect hash path
+        auto knownStart = chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i)
+        {
+            checksum += (uintptr_t)ShapeFactory::findCreator(knownShapeNames[i % KNOWN_SHAPE_COUNT]);
+        }
+        auto knownEnd = chrono::steady_clock::now();
+        cout << "    built-in names only: " << chrono::duration<double, nano>(knownEnd - knownStart).count() / lookups
+             << " ns/lookup" << endl;
+    }
+}
+
+// Resident set size in KB (Linux), 0 elsewhere
+long residentKilobytes()
 {
+#ifdef __linux__
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+        {
+            return atol(line.c_str() + 6);
+        }
+    }
+#endif
+    return 0;
+}
+
+// Run a benchmark section in a child process (Linux), so its memory numbers do not include what earlier
+// sections left behind (freed heap kept by malloc, pools that never shrink); elsewhere it runs in place
+void runInOwnProcess(const function<void()>& section)
+{
+#ifdef __linux__
+    cout << flush;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        section();
+        cout << flush;
+        _exit(0);
+    }
+    if (child > 0)
+    {
+        waitpid(child, nullptr, 0);
+        return;
+    }
+#endif
+    section();
+}
+
+// Frames of 1M shapes each: plain new/delete vs per-type pools vs a frame arena
+// Each strategy runs in its own process and reports how much its peak RSS (with a frame alive) grew over
+// the RSS with the empty frame array, so only the shapes themselves are counted
+void runFrameBenchmark()
+{
+    const int frames = 10;
+    const int shapesPerFrame = 1000000;
+    const string names[] = { "Circle", "Square", "Rectangle" };
+
+    auto report = [](const char* label, chrono::steady_clock::duration time, long rssGrowth)
+    {
+        double seconds = chrono::duration<double>(time).count();
+        cout << label << (long long)(frames * (double)shapesPerFrame / seconds) << " shapes/sec, RSS growth with a frame alive "
+             << rssGrowth / 1024 << " MB" << endl;
+    };
+
+    runInOwnProcess([&]()
+    {
+        ShapeFactory factory;
+        vector<Shape*> frame(shapesPerFrame);
+        long baseline = residentKilobytes();
+        long rss = baseline;
+        auto start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int i = 0; i < shapesPerFrame; ++i)
+            {
+                frame[i] = factory.getShape(names[i % 3]);
+            }
+            rss = max(rss, residentKilobytes());
+            for (Shape* shape : frame)
+            {
+                delete shape;
+            }
+        }
+        report("new/delete: ", chrono::steady_clock::now() - start, rss - baseline);
+    });
+
+    runInOwnProcess([&]()
+    {
+        ShapeFactory factory;
+        vector<ShapeHandle> frame(shapesPerFrame);
+        frame.clear();
+        long baseline = residentKilobytes();
+        long rss = baseline;
+        auto start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int i = 0; i < shapesPerFrame; ++i)
+            {
+                frame.push_back(factory.getPooledShape(names[i % 3]));
+            }
+            rss = max(rss, residentKilobytes());
+            frame.clear();
+        }
+        report("pools:      ", chrono::steady_clock::now() - start, rss - baseline);
+    });
+
+    runInOwnProcess([&]()
+    {
+        ShapeFactory factory;
+        ShapeArena arena;
+        vector<ShapeHandle> frame(shapesPerFrame);
+        frame.clear();
+        long baseline = residentKilobytes();
+        long rss = baseline;
+        auto start = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int i = 0; i < shapesPerFrame; ++i)
+            {
+                frame.push_back(factory.getShape(names[i % 3], arena));
+            }
+            rss = max(rss, residentKilobytes());
+            frame.clear();
+            arena.reset();
+        }
+        report("arena:      ", chrono::steady_clock::now() - start, rss - baseline);
+    });
+}
+
+// 10M shapes: one getShape() per shape and a virtual call per visit vs createBatch() and visitAll()
+void runBatchBenchmark()
+{
+    const size_t total = 10000000;
+    const string names[] = { "Circle", "Square", "Rectangle" };
+    ShapeFactory factory;
+    auto nsPerShape = [total](chrono::steady_clock::duration time)
+    {
+        return chrono::duration<double, nano>(time).count() / total;
+    };
+
+    // one heap object per shape, types interleaved as a caller would create them
+    double sumVirtual = 0;
+    {
+        vector<Shape*> shapes(total);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < total; ++i)
+        {
+            shapes[i] = factory.getShape(names[i % 3]);
+            ShapePosition& position = builtInPosition(shapes[i], (ShapeKind)(i % 3));
+            position.x = (float)(i & 1023);
+            position.y = 1.0f;
+        }
+        auto created = chrono::steady_clock::now();
+        for (Shape* shape : shapes)
+        {
+            // centre of the bounds, exact for these sizes
+            ShapeBounds box = shape->bounds();
+            sumVirtual += (box.minX + box.maxX) * 0.5f * ((box.minY + box.maxY) * 0.5f);
+        }
+        auto visited = chrono::steady_clock::now();
+        cout << "one by one: create " << nsPerShape(created - start) << " ns/shape, visit "
+             << nsPerShape(visited - created) << " ns/shape" << endl;
+        for (Shape* shape : shapes)
+        {
+            delete shape;
+        }
+    }
+
+    // same shapes in three batches, stored column by column
+    double sumBatch = 0;
+    {
+        auto start = chrono::steady_clock::now();
+        for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+        {
+            // shapes i with i % 3 == k
+            size_t count = total / 3 + (k < total % 3 ? 1 : 0);
+            ShapeBatch batch = factory.createBatch(names[k], count);
+            ShapeStore::Columns& columns = factory.batchColumns(batch.kind);
+            for (size_t j = 0; j < batch.count; ++j)
+            {
+                columns.x[batch.first + j] = (float)((j * 3 + k) & 1023);
+                columns.y[batch.first + j] = 1.0f;
+            }
+        }
+        auto created = chrono::steady_clock::now();
+        factory.visitAll([&sumBatch](ShapeKind, size_t, float x, float y)
+        {
+            sumBatch += x * y;
+        });
+        auto visited = chrono::steady_clock::now();
+        cout << "batches:    create " << nsPerShape(created - start) << " ns/shape, visit "
+             << nsPerShape(visited - created) << " ns/shape" << (sumBatch == sumVirtual ? "" : " (mismatch!)") << endl;
+    }
+}
+
+// Mixed workloads of 1M shapes, 20 passes each: virtual calls through Shape*, std::visit over a
+// vector<ShapeValue>, and type-sorted vectors of each concrete class
+void runDispatchBenchmark()
+{
+    const size_t total = 1000000;
+    const int passes = 20;
+    const string names[] = { "Circle", "Square", "Rectangle" };
+    // chance (in percent) of a Circle and of a Square, the rest are Rectangles
+    const struct { const char* label; int circles; int squares; } mixes[] = {
+        { "uniform mix", 34, 33 }, { "90% circles", 90, 5 }
+    };
+
+    for (const auto& mix : mixes)
+    {
+        mt19937 random(42);
+        uniform_int_distribution<int> percent(0, 99);
+        vector<size_t> kinds(total);
+        for (size_t& kind : kinds)
+        {
+            int draw = percent(random);
+            kind = draw < mix.circles ? 0 : draw < mix.circles + mix.squares ? 1 : 2;
+        }
+
+        ShapeFactory factory;
+        vector<Shape*> pointers(total);
+        vector<ShapeValue> values;
+        values.reserve(total);
+        vector<Circle> circles;
+        vector<Square> squares;
+        vector<Rectangle> rectangles;
+        for (size_t i = 0; i < total; ++i)
+        {
+            float x = (float)(i & 1023);
+            pointers[i] = factory.getShape(names[kinds[i]]);
+            builtInPosition(pointers[i], (ShapeKind)kinds[i]).x = x;
+            values.push_back(*ShapeFactory::getShapeValue(names[kinds[i]]));
+            visit([x](ShapePosition& shape) { shape.x = x; }, values.back());
+            switch (kinds[i])
+            {
+            case 0:
+                circles.emplace_back().x = x;
+                break;
+            case 1:
+                squares.emplace_back().x = x;
+                break;
+            default:
+                rectangles.emplace_back().x = x;
+                break;
+            }
+        }
+
+        auto time = [&](auto pass)
+        {
+            double sum = 0;
+            auto start = chrono::steady_clock::now();
+            for (int p = 0; p < passes; ++p)
+            {
+                sum += pass();
+            }
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)total * passes);
+            return make_pair(ns, sum);
+        };
+
+        auto virtualCalls = time([&]
+        {
+            float sum = 0;
+            for (Shape* shape : pointers)
+            {
+                sum += shape->bounds().minX;
+            }
+            return sum;
+        });
+        auto variantCalls = time([&]
+        {
+            float sum = 0;
+            for (const ShapeValue& value : values)
+            {
+                sum += visit([](const auto& shape) { return shape.bounds().minX; }, value);
+            }
+            return sum;
+        });
+        // sizes read through volatile, otherwise the compiler computes the sorted pass once for all passes
+        volatile size_t sortedSizes[] = { circles.size(), squares.size(), rectangles.size() };
+        auto sortedCalls = time([&]
+        {
+            float sum = 0;
+            for (size_t i = 0, n = sortedSizes[0]; i < n; ++i)
+            {
+                sum += circles[i].bounds().minX;
+            }
+            for (size_t i = 0, n = sortedSizes[1]; i < n; ++i)
+            {
+                sum += squares[i].bounds().minX;
+            }
+            for (size_t i = 0, n = sortedSizes[2]; i < n; ++i)
+            {
+                sum += rectangles[i].bounds().minX;
+            }
+            return sum;
+        });
+
+        // keeps the sorted pass from being dropped as dead code
+        volatile double sink = sortedCalls.second;
+        (void)sink;
+        cout << mix.label << ": virtual " << virtualCalls.first << " ns/shape, variant " << variantCalls.first
+             << " ns/shape, type-sorted " << sortedCalls.first << " ns/shape" << endl;
+        // the sorted pass adds in a different order, so only the virtual and variant sums must be identical
+        if (virtualCalls.second != variantCalls.second)
+        {
+            cout << "    (mismatch!)" << endl;
+        }
+
+        for (Shape* shape : pointers)
+        {
+            delete shape;
+        }
+    }
+}
+
+// Random shapes of every kind through the geometry kernels: the vectorized kernel must match the scalar one
+// exactly, and the scalar one must agree with the virtual area()/perimeter()/bounds() of the classes
+bool runGeometryCheck()
+{
+    const size_t count = 1003;    // not a multiple of 8, so the scalar tail runs too
+    mt19937 random(7);
+    uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    uniform_real_distribution<float> extent(0.01f, 100.0f);
+    bool ok = true;
+
+    auto close = [](float a, float b)
+    {
+        return fabs(a - b) <= 1e-5f * max(1.0f, max(fabs(a), fabs(b)));
+    };
+
+    for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+    {
+        ShapeKind kind = (ShapeKind)k;
+        ShapeStore::Columns columns;
+        vector<unique_ptr<Shape>> shapes;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float first = extent(random);
+            float second = extent(random);
+            Shape* shape = nullptr;
+            float width = 0;
+            float height = 0;
+            switch (kind)
+            {
+            case ShapeKind::Circle:
+                shape = new Circle(first);
+                width = height = 2 * first;
+                break;
+            case ShapeKind::Square:
+                shape = new Square(first);
+                width = height = first;
+                break;
+            case ShapeKind::Rectangle:
+                shape = new Rectangle(first, second);
+                width = first;
+                height = second;
+                break;
+            }
+            ShapePosition& centre = builtInPosition(shape, kind);
+            centre.x = position(random);
+            centre.y = position(random);
+            shapes.emplace_back(shape);
+            columns.x.push_back(centre.x);
+            columns.y.push_back(centre.y);
+            columns.width.push_back(width);
+            columns.height.push_back(height);
+        }
+
+        ShapeGeometry scalar;
+        computeGeometry(kind, columns, scalar, &computeGeometryScalar);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ShapeBounds bounds = shapes[i]->bounds();
+            if (!close(scalar.area[i], shapes[i]->area()) || !close(scalar.perimeter[i], shapes[i]->perimeter()) ||
+                !close(scalar.minX[i], bounds.minX) || !close(scalar.minY[i], bounds.minY) ||
+                !close(scalar.maxX[i], bounds.maxX) || !close(scalar.maxY[i], bounds.maxY))
+            {
+                cout << "FAILED: scalar kernel disagrees with " << knownShapeNames[k] << " #" << i << endl;
+                ok = false;
+                break;
+            }
+        }
+
+        if (geometryKernel().kernel != &computeGeometryScalar)
+        {
+            ShapeGeometry vectorized;
+            computeGeometry(kind, columns, vectorized, geometryKernel().kernel);
+            if (vectorized.area != scalar.area || vectorized.perimeter != scalar.perimeter ||
+                vectorized.minX != scalar.minX || vectorized.minY != scalar.minY ||
+                vectorized.maxX != scalar.maxX || vectorized.maxY != scalar.maxY)
+            {
+                cout << "FAILED: " << geometryKernel().name << " kernel differs from scalar for " << knownShapeNames[k] << endl;
+                ok = false;
+            }
+        }
+    }
+
+    // default shapes: a batch must have the geometry of getShape() for the same name
+    ShapeFactory factory;
+    for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+    {
+        ShapeKind kind = (ShapeKind)k;
+        ShapeBatch batch = factory.createBatch(knownShapeNames[k], 1);
+        ShapeGeometry geometry;
+        factory.computeGeometry(kind, geometry);
+        unique_ptr<Shape> shape(factory.getShape(string(knownShapeNames[k])));
+        ShapeBounds bounds = shape->bounds();
+        size_t i = batch.first;
+        if (!close(geometry.area[i], shape->area()) || !close(geometry.perimeter[i], shape->perimeter()) ||
+            !close(geometry.minX[i], bounds.minX) || !close(geometry.minY[i], bounds.minY) ||
+            !close(geometry.maxX[i], bounds.maxX) || !close(geometry.maxY[i], bounds.maxY))
+        {
+            cout << "FAILED: default " << knownShapeNames[k] << " batch has area " << geometry.area[i] << ", getShape() "
+                 << shape->area() << endl;
+            ok = false;
+        }
+    }
+
+    cout << "geometry check (" << geometryKernel().name << " kernel): " << (ok ? "passed" : "FAILED") << endl;
+    return ok;
+}
+
+// 10M shapes of each kind through the scalar kernel and the one chosen for this CPU
+void runGeometryBenchmark()
+{
+    const size_t perKind = 10000000;
+    const int passes = 5;
+    ShapeFactory factory;
+    for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+    {
+        ShapeBatch batch = factory.createBatch(knownShapeNames[k], perKind);
+        ShapeStore::Columns& columns = factory.batchColumns(batch.kind);
+        for (size_t i = 0; i < perKind; ++i)
+        {
+            columns.x[i] = (float)(i & 4095);
+            columns.y[i] = (float)(i >> 12);
+            columns.width[i] = 1.0f + (float)(i & 15);
+            columns.height[i] = k == 2 ? 2.0f + (float)(i & 7) : columns.width[i];
+        }
+    }
+
+    ShapeGeometry out;
+    out.resize(perKind);    // touch the output pages before timing
+    auto run = [&](const char* label, GeometryKernel kernel)
+    {
+        auto start = chrono::steady_clock::now();
+        for (int p = 0; p < passes; ++p)
+        {
+            for (size_t k = 0; k < SHAPE_KIND_COUNT; ++k)
+            {
+                computeGeometry((ShapeKind)k, factory.batchColumns((ShapeKind)k), out, kernel);
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << label << " kernel: " << (long long)(passes * SHAPE_KIND_COUNT * perKind / seconds) << " shapes/sec" << endl;
+    };
+    run("scalar", &computeGeometryScalar);
+    if (geometryKernel().kernel != &computeGeometryScalar)
+    {
+        run(geometryKernel().name, geometryKernel().kernel);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // ./a.out bench  -> run the benchmarks instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runLookupBenchmark();
+        runFrameBenchmark();
+        runBatchBenchmark();
+        runDispatchBenchmark();
+        runGeometryBenchmark();
+        return 0;
+    }
+
+    // ./a.out check  -> compare the geometry kernels
+    if (argc > 1 && string(argv[1]) == "check")
+    {
+        return runGeometryCheck() ? 0 : 1;
+    }
+
     ShapeFactory factory;
 
     // Create shapes
@@ -115,6 +1554,42 @@ int main()
     delete square;
     delete rectangle;
 
+    // Pooled shape, the handle returns it to the Circle pool
+    ShapeHandle pooled = factory.getPooledShape("Circle");
+    pooled->draw();
+
+    // Frame arena, one reset() frees every shape of the frame
+    ShapeArena frame;
+    ShapeHandle framed = factory.getShape("Square", frame);
+    framed->draw();
+    framed.reset();
+    frame.reset();
+
+    // Batch creation, drawAll() walks the shapes type by type
+    factory.createBatch("Circle", 2);
+    factory.createBatch("Rectangle", 1);
+    factory.drawAll();
+
+    // Geometry of the batch, computed column by column
+    ShapeGeometry geometry;
+    factory.computeGeometry(ShapeKind::Rectangle, geometry);
+    cout << "Rectangle area " << geometry.area[0] << ", perimeter " << geometry.perimeter[0] << endl;
+    factory.clearBatches();
+
+    // Shapes by value, std::visit calls the concrete draw() directly
+    vector<ShapeValue> values;
+    for (const char* name : { "Square", "Circle" })
+    {
+        if (optional<ShapeValue> value = ShapeFactory::getShapeValue(name))
+        {
+            values.push_back(*value);
+        }
+    }
+    for (ShapeValue& value : values)
+    {
+        visit([](auto& shape) { shape.draw(); }, value);
+    }
+
     return 0;
 }
 
@@ -1,8 +1,231 @@
+// compile:- g++ -std=c++17 -O2 -pthread observer_design_pattern.cpp
+// run "./a.out bench" for the benchmarks, "./a.out alloc" for the allocation check, "./a.out check" for the
+// detach check
+// (the allocation check needs -DOBSERVER_COUNT_ALLOCATIONS=1)
+
 #include <iostream>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <future>
+#include <condition_variable>
 using namespace std;
 
+// Replace the global operator new with a counting one for the allocation check ("./a.out alloc")
+// Off by default so the demo and the benchmarks do not pay for it
+#ifndef OBSERVER_COUNT_ALLOCATIONS
+#define OBSERVER_COUNT_ALLOCATIONS 0
+#endif
+
+// Interned id of an item name
+typedef uint32_t ItemId;
+
+// Global symbol table of item names
+//
+// ---> every distinct name is stored once, packed into 1 MB character blocks, and gets a 32-bit id.
+// ---> name(id) is lock-free; only intern() of a new name takes the mutex.
+// ---> blocks and entry chunks never move, so a string_view from name() stays valid for the whole program.
+class ItemNames
+{
+    static const size_t ENTRY_CHUNK = 65536;
+    static const size_t MAX_ENTRY_CHUNKS = 65536;
+    static const size_t BLOCK_SIZE = 1 << 20;
+    static const size_t MAX_BLOCKS = 65536;
+    static const uint64_t OFFSET_MASK = (1ULL << 40) - 1;
+
+    // entry = (length << 40) | offset of the first character
+    unique_ptr<atomic<uint64_t*>[]> entryChunks;
+    unique_ptr<atomic<char*>[]> blocks;
+    vector<char*> allocations;
+
+    atomic<uint32_t> count;
+    uint64_t charsUsed;
+
+    // Open addressing table of id + 1 (0 = empty), only touched under internMutex
+    vector<uint32_t> index;
+    mutex internMutex;
+
+    // Constructor
+    ItemNames() : entryChunks(new atomic<uint64_t*>[MAX_ENTRY_CHUNKS]), blocks(new atomic<char*>[MAX_BLOCKS]),
+                  count(0), charsUsed(0), index(1024, 0)
+    {
+        for (size_t i = 0; i < MAX_ENTRY_CHUNKS; ++i)
+        {
+            entryChunks[i].store(nullptr, memory_order_relaxed);
+        }
+        for (size_t i = 0; i < MAX_BLOCKS; ++i)
+        {
+            blocks[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+
+    // FNV-1a
+    static uint64_t hashName(string_view name)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : name)
+        {
+            hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Copy the characters into the blocks, returns the offset
+    uint64_t storeChars(string_view name)
+    {
+        if (name.size() > BLOCK_SIZE)
+        {
+            // oversized name: its own allocation, covering as many block numbers as it needs
+            uint64_t offset = (charsUsed + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+            size_t blockCount = (name.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            char* memory = new char[blockCount * BLOCK_SIZE];
+            allocations.push_back(memory);
+            for (size_t i = 0; i < blockCount; ++i)
+            {
+                blocks[offset / BLOCK_SIZE + i].store(memory + i * BLOCK_SIZE, memory_order_release);
+            }
+            memcpy(memory, name.data(), name.size());
+            charsUsed = offset + blockCount * BLOCK_SIZE;
+            return offset;
+        }
+
+        // names never span two blocks
+        if (charsUsed % BLOCK_SIZE + name.size() > BLOCK_SIZE)
+        {
+            charsUsed = (charsUsed / BLOCK_SIZE + 1) * BLOCK_SIZE;
+        }
+        char* block = blocks[charsUsed / BLOCK_SIZE].load(memory_order_relaxed);
+        if (block == nullptr)
+        {
+            block = new char[BLOCK_SIZE];
+            allocations.push_back(block);
+            blocks[charsUsed / BLOCK_SIZE].store(block, memory_order_release);
+        }
+        uint64_t offset = charsUsed;
+        memcpy(block + offset % BLOCK_SIZE, name.data(), name.size());
+        charsUsed += name.size();
+        return offset;
+    }
+
+    // Double the hash table, caller holds internMutex
+    void grow()
+    {
+        vector<uint32_t> bigger(index.size() * 2, 0);
+        size_t mask = bigger.size() - 1;
+        for (uint32_t slot : index)
+        {
+            if (slot != 0)
+            {
+                size_t pos = hashName(name(slot - 1)) & mask;
+                while (bigger[pos] != 0)
+                {
+                    pos = (pos + 1) & mask;
+                }
+                bigger[pos] = slot;
+            }
+        }
+        index.swap(bigger);
+    }
+
+    public:
+
+    // Destructor
+    ~ItemNames()
+    {
+        for (size_t i = 0; i < MAX_ENTRY_CHUNKS; ++i)
+        {
+            delete[] entryChunks[i].load();
+        }
+        for (char* memory : allocations)
+        {
+            delete[] memory;
+        }
+    }
+
+    // The table
+    static ItemNames& instance()
+    {
+        static ItemNames names;
+        return names;
+    }
+
+    // Id of a name, added if new
+    ItemId intern(string_view name)
+    {
+        lock_guard<mutex> lock(internMutex);
+        size_t mask = index.size() - 1;
+        size_t pos = hashName(name) & mask;
+        while (index[pos] != 0)
+        {
+            if (this->name(index[pos] - 1) == name)
+            {
+                return index[pos] - 1;
+            }
+            pos = (pos + 1) & mask;
+        }
+
+        ItemId id = count.load(memory_order_relaxed);
+        uint64_t* chunk = entryChunks[id / ENTRY_CHUNK].load(memory_order_relaxed);
+        if (chunk == nullptr)
+        {
+            chunk = new uint64_t[ENTRY_CHUNK];
+            entryChunks[id / ENTRY_CHUNK].store(chunk, memory_order_release);
+        }
+        uint64_t offset = storeChars(name);
+        chunk[id % ENTRY_CHUNK] = ((uint64_t)name.size() << 40) | offset;
+        count.store(id + 1, memory_order_release);
+
+        index[pos] = id + 1;
+        // keep the table at most 3/4 full
+        if ((size_t)(id + 1) * 4 > index.size() * 3)
+        {
+            grow();
+        }
+        return id;
+    }
+
+    // Name of an id
+    string_view name(ItemId id) const
+    {
+        uint64_t entry = entryChunks[id / ENTRY_CHUNK].load(memory_order_acquire)[id % ENTRY_CHUNK];
+        uint64_t offset = entry & OFFSET_MASK;
+        size_t length = (size_t)(entry >> 40);
+        if (length == 0)
+        {
+            return string_view();
+        }
+        return string_view(blocks[offset / BLOCK_SIZE].load(memory_order_acquire) + offset % BLOCK_SIZE, length);
+    }
+
+    // Number of names
+    size_t size() const
+    {
+        return count.load(memory_order_acquire);
+    }
+
+    // Bytes used by characters, entries and the hash table
+    size_t memoryBytes() const
+    {
+        size_t entryChunkCount = (size() + ENTRY_CHUNK - 1) / ENTRY_CHUNK;
+        return (charsUsed + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE + entryChunkCount * ENTRY_CHUNK * sizeof(uint64_t) +
+               index.size() * sizeof(uint32_t);
+    }
+};
+
 // Declaration of Subject interface
 class Subject;
 
@@ -13,104 +236,1685 @@ class Observer
     
     // Pure virtual function to update the observer with the item name
     virtual void update(const string& itemName) = 0;
+
+    // Update the observer with the interned id of the item (used by AmazonItem)
+    // By default the name is looked up and passed to update(), override to avoid building a string
+    virtual void updateItem(ItemId itemId)
+    {
+        update(string(ItemNames::instance().name(itemId)));
+    }
+
+    // Update the observer with several items at once (used by SubscriptionCatalog)
+    // By default one updateItem() per item
+    virtual void updateBatch(const vector<ItemId>& itemIds)
+    {
+        for (ItemId itemId : itemIds)
+        {
+            updateItem(itemId);
+        }
+    }
+
+    // Virtual destructor
+    virtual ~Observer() {}
+};
+
+// Handle returned by subscribe(), needed to unsubscribe in O(1)
+struct ObserverHandle
+{
+    unsigned int shard;
+    unsigned int index;
+    unsigned int generation;
+};
+
+// Registry of observers for one subject
+//
+// ---> attach/detach are O(1) and lock-free: a slot comes from a per-shard free list (or a fresh
+//      index) and detaching just clears the slot. Shards keep attaching threads off each other's cache lines.
+// ---> forEach() walks the slots without locks while attach/detach go on. Every slot is read atomically,
+//      so an observer is either seen or not, never half written.
+// ---> detach() waits (epoch based, like RCU) until every forEach() that might still see the observer has
+//      finished, so the caller may delete the observer right after. From inside any forEach() (an update() of
+//      this or another registry) it never waits, as two threads detaching from each other's registry would wait
+//      for each other: it only unlinks the observer, and the reclaim callback (which deletes it) runs after the
+//      grace period, when the thread's outermost forEach() ends.
+class ObserverRegistry
+{
+    static const unsigned int SHARDS = 8;
+
+    // Chunk k of a shard holds FIRST_CHUNK << k slots, chunks are never moved or freed while in use
+    static const unsigned int FIRST_CHUNK = 64;
+    static const unsigned int MAX_CHUNKS = 26;
+
+    struct Slot
+    {
+        atomic<Observer*> observer;
+        atomic<unsigned int> generation;
+        atomic<unsigned int> nextFree;
+
+        Slot() : observer(nullptr), generation(0), nextFree(0) {}
+    };
+
+    struct alignas(64) Shard
+    {
+        atomic<Slot*> chunks[MAX_CHUNKS];
+        atomic<unsigned int> allocated;             // indices handed out so far
+        atomic<unsigned long long> freeHead;        // (tag << 32) | (index + 1), 0 = empty
+
+        Shard() : allocated(0), freeHead(0)
+        {
+            for (auto& chunk : chunks)
+            {
+                chunk.store(nullptr, memory_order_relaxed);
+            }
+        }
+    };
+
+    Shard shards[SHARDS];
+
+    // Epoch based grace period for detach()
+    atomic<unsigned long long> epoch;
+    atomic<long> readers[2];
+    mutex synchronizeMutex;
+
+    // A forEach() running on this thread, they form a stack across registries (update() may detach,
+    // possibly from another registry's notify)
+    struct ReadSection
+    {
+        const ObserverRegistry* registry;
+        int parity;
+        ReadSection* outer;
+    };
+
+    // Innermost forEach() of the calling thread
+    static ReadSection*& innermostRead()
+    {
+        thread_local ReadSection* innermost = nullptr;
+        return innermost;
+    }
+
+    // Observer detached from inside a forEach(), reclaimed once its registry's grace period is over
+    struct Retired
+    {
+        ObserverRegistry* registry;
+        function<void()> reclaim;
+    };
+
+    // Observers the calling thread detached while reading, drained when its outermost forEach() ends
+    static vector<Retired>& retiredOnThisThread()
+    {
+        thread_local vector<Retired> retired;
+        return retired;
+    }
+
+    // Wait out the grace period of every registry with retired observers, then reclaim them
+    // (runs outside any read section, so waiting cannot deadlock with another reader)
+    static void drainRetired()
+    {
+        while (!retiredOnThisThread().empty())
+        {
+            vector<Retired> batch;
+            batch.swap(retiredOnThisThread());
+            vector<ObserverRegistry*> waited;
+            for (Retired& retired : batch)
+            {
+                if (find(waited.begin(), waited.end(), retired.registry) == waited.end())
+                {
+                    retired.registry->synchronize();
+                    waited.push_back(retired.registry);
+                }
+            }
+            for (Retired& retired : batch)
+            {
+                if (retired.reclaim)
+                {
+                    retired.reclaim();
+                }
+            }
+        }
+    }
+
+    // Chunk number and offset of an index
+    static void locate(unsigned int index, unsigned int& chunk, unsigned int& offset)
+    {
+        unsigned int v = index / FIRST_CHUNK + 1;
+        chunk = 0;
+        while (v >>= 1)
+        {
+            ++chunk;
+        }
+        offset = index - FIRST_CHUNK * ((1u << chunk) - 1);
+    }
+
+    // Slot of an index, nullptr if its chunk is not there yet
+    static Slot* slotAt(Shard& shard, unsigned int index)
+    {
+        unsigned int chunk, offset;
+        locate(index, chunk, offset);
+        if (chunk >= MAX_CHUNKS)
+        {
+            return nullptr;
+        }
+        Slot* slots = shard.chunks[chunk].load(memory_order_acquire);
+        return slots == nullptr ? nullptr : &slots[offset];
+    }
+
+    // Slot of an index, allocating its chunk if needed
+    static Slot* slotFor(Shard& shard, unsigned int index)
+    {
+        unsigned int chunk, offset;
+        locate(index, chunk, offset);
+        Slot* slots = shard.chunks[chunk].load(memory_order_acquire);
+        if (slots == nullptr)
+        {
+            Slot* fresh = new Slot[FIRST_CHUNK << chunk];
+            if (shard.chunks[chunk].compare_exchange_strong(slots, fresh, memory_order_acq_rel))
+            {
+                slots = fresh;
+            }
+            else
+            {
+                // another thread installed it first
+                delete[] fresh;
+            }
+        }
+        return &slots[offset];
+    }
+
+    // Shard of the calling thread
+    static unsigned int localShard()
+    {
+        thread_local unsigned int shard = (unsigned int)(hash<thread::id>()(this_thread::get_id()) % SHARDS);
+        return shard;
+    }
+
+    // Take a free index of the shard, or a fresh one
+    static unsigned int takeIndex(Shard& shard)
+    {
+        unsigned long long head = shard.freeHead.load(memory_order_acquire);
+        while ((head & 0xffffffffULL) != 0)
+        {
+            unsigned int index = (unsigned int)(head & 0xffffffffULL) - 1;
+            unsigned long long next = slotAt(shard, index)->nextFree.load(memory_order_relaxed);
+            unsigned long long tag = (head >> 32) + 1;
+            if (shard.freeHead.compare_exchange_weak(head, (tag << 32) | next, memory_order_acq_rel))
+            {
+                return index;
+            }
+        }
+        return shard.allocated.fetch_add(1, memory_order_relaxed);
+    }
+
+    // Give an index back to the shard's free list
+    static void releaseIndex(Shard& shard, unsigned int index, Slot* slot)
+    {
+        unsigned long long head = shard.freeHead.load(memory_order_relaxed);
+        do
+        {
+            slot->nextFree.store((unsigned int)(head & 0xffffffffULL), memory_order_relaxed);
+        }
+        while (!shard.freeHead.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | (index + 1), memory_order_acq_rel));
+    }
+
+    // Mark the calling thread as reading, section remembers the counter to release
+    void enterRead(ReadSection& section)
+    {
+        section.registry = this;
+        section.outer = innermostRead();
+        innermostRead() = &section;
+        for (;;)
+        {
+            unsigned long long current = epoch.load();
+            section.parity = (int)(current & 1);
+            readers[section.parity].fetch_add(1);
+            if (epoch.load() == current)
+            {
+                return;
+            }
+            readers[section.parity].fetch_sub(1);
+        }
+    }
+
+    // End of a read section, the outermost one reclaims what the thread detached meanwhile
+    void exitRead(const ReadSection& section)
+    {
+        readers[section.parity].fetch_sub(1);
+        innermostRead() = section.outer;
+        if (section.outer == nullptr && !retiredOnThisThread().empty())
+        {
+            drainRetired();
+        }
+    }
+
+    // Wait until every read section that started before this call has ended
+    void synchronize()
+    {
+        lock_guard<mutex> lock(synchronizeMutex);
+        for (int phase = 0; phase < 2; ++phase)
+        {
+            unsigned long long previous = epoch.fetch_add(1);
+            while (readers[previous & 1].load() != 0)
+            {
+                this_thread::yield();
+            }
+        }
+    }
+
+    public:
+
+    // Constructor
+    ObserverRegistry() : epoch(0)
+    {
+        readers[0].store(0);
+        readers[1].store(0);
+    }
+
+    // Destructor
+    ~ObserverRegistry()
+    {
+        for (auto& shard : shards)
+        {
+            for (auto& chunk : shard.chunks)
+            {
+                delete[] chunk.load();
+            }
+        }
+    }
+
+    ObserverRegistry(const ObserverRegistry&) = delete;
+    ObserverRegistry& operator=(const ObserverRegistry&) = delete;
+
+    // Add an observer
+    ObserverHandle attach(Observer* observer)
+    {
+        unsigned int shardIndex = localShard();
+        Shard& shard = shards[shardIndex];
+        unsigned int index = takeIndex(shard);
+        Slot* slot = slotFor(shard, index);
+        slot->observer.store(observer, memory_order_release);
+        return ObserverHandle{ shardIndex, index, slot->generation.load(memory_order_acquire) };
+    }
+
+    // Remove an observer, returns false if the handle was already detached
+    // reclaim (e.g. deleting the observer) runs once no forEach() can see the observer any more: before
+    // detach() returns, or, when called from inside a forEach(), when the thread's outermost forEach() ends
+    bool detach(const ObserverHandle& handle, function<void()> reclaim = nullptr)
+    {
+        if (handle.shard >= SHARDS)
+        {
+            return false;
+        }
+        Shard& shard = shards[handle.shard];
+        Slot* slot = slotAt(shard, handle.index);
+        unsigned int generation = handle.generation;
+        if (slot == nullptr || !slot->generation.compare_exchange_strong(generation, generation + 1, memory_order_acq_rel))
+        {
+            return false;
+        }
+
+        slot->observer.store(nullptr, memory_order_release);
+        releaseIndex(shard, handle.index, slot);
+
+        // a reading thread would wait for itself, or for a thread waiting for it
+        if (innermostRead() != nullptr)
+        {
+            retiredOnThisThread().push_back(Retired{ this, move(reclaim) });
+            return true;
+        }
+        synchronize();
+        if (reclaim)
+        {
+            reclaim();
+        }
+        return true;
+    }
+
+    // Number of shards
+    unsigned int shardCount() const
+    {
+        return SHARDS;
+    }
+
+    // Number of slots handed out in a shard (live or free), the bound for forEachInRange()
+    unsigned int slotCount(unsigned int shard) const
+    {
+        return shards[shard].allocated.load(memory_order_acquire);
+    }
+
+    // Call function(observer) for the observers in slots [begin, end) of a shard
+    template<typename Function>
+    void forEachInRange(unsigned int shard, unsigned int begin, unsigned int end, Function function)
+    {
+        ReadSection section;
+        enterRead(section);
+        unsigned int index = begin;
+        while (index < end)
+        {
+            unsigned int chunk, offset;
+            locate(index, chunk, offset);
+            if (chunk >= MAX_CHUNKS)
+            {
+                break;
+            }
+            unsigned int count = min((FIRST_CHUNK << chunk) - offset, end - index);
+            Slot* slots = shards[shard].chunks[chunk].load(memory_order_acquire);
+            for (unsigned int i = 0; slots != nullptr && i < count; ++i)
+            {
+                Observer* observer = slots[offset + i].observer.load(memory_order_acquire);
+                if (observer != nullptr)
+                {
+                    function(observer);
+                }
+            }
+            index += count;
+        }
+        exitRead(section);
+    }
+
+    // Call function(observer) for every attached observer
+    template<typename Function>
+    void forEach(Function function)
+    {
+        ReadSection section;
+        enterRead(section);
+        for (auto& shard : shards)
+        {
+            unsigned int allocated = shard.allocated.load(memory_order_acquire);
+            for (unsigned int chunk = 0, begin = 0; chunk < MAX_CHUNKS && begin < allocated; ++chunk)
+            {
+                unsigned int size = FIRST_CHUNK << chunk;
+                Slot* slots = shard.chunks[chunk].load(memory_order_acquire);
+                unsigned int count = min(size, allocated - begin);
+                for (unsigned int i = 0; slots != nullptr && i < count; ++i)
+                {
+                    Observer* observer = slots[i].observer.load(memory_order_acquire);
+                    if (observer != nullptr)
+                    {
+                        function(observer);
+                    }
+                }
+                begin += size;
+            }
+        }
+        exitRead(section);
+    }
+};
+
+// Thread pool where every worker has its own task deque: a worker takes its newest task first
+// and, when it runs dry, steals the oldest task of another worker
+class WorkStealingPool
+{
+    struct alignas(64) Worker
+    {
+        mutex tasksMutex;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+
+    atomic<bool> stopping;
+    atomic<long> queued;
+    atomic<size_t> nextWorker;
+    mutex sleepMutex;
+    condition_variable wake;
+
+    // Index of the calling worker in this pool, -1 for outside threads
+    int& localIndex()
+    {
+        thread_local WorkStealingPool* pool = nullptr;
+        thread_local int index = -1;
+        if (pool != this)
+        {
+            pool = this;
+            index = -1;
+        }
+        return index;
+    }
+
+    // Take a task from our own deque (newest) or steal one (oldest)
+    bool takeTask(int self, function<void()>& task)
+    {
+        size_t count = workers.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            Worker& worker = *workers[(self + i) % count];
+            lock_guard<mutex> lock(worker.tasksMutex);
+            if (!worker.tasks.empty())
+            {
+                if (i == 0)
+                {
+                    task = move(worker.tasks.back());
+                    worker.tasks.pop_back();
+                }
+                else
+                {
+                    task = move(worker.tasks.front());
+                    worker.tasks.pop_front();
+                }
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Worker thread
+    void workerLoop(int self)
+    {
+        localIndex() = self;
+        function<void()> task;
+        for (;;)
+        {
+            if (takeTask(self, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            unique_lock<mutex> lock(sleepMutex);
+            if (stopping.load())
+            {
+                return;
+            }
+            wake.wait(lock, [this]() { return queued.load() > 0 || stopping.load(); });
+        }
+    }
+
+    public:
+
+    // Constructor, 0 threads means one per core
+    WorkStealingPool(unsigned int threadCount = 0) : stopping(false), queued(0), nextWorker(0)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = max(1u, thread::hardware_concurrency());
+        }
+        for (unsigned int i = 0; i < threadCount; ++i)
+        {
+            workers.emplace_back(new Worker());
+        }
+        for (unsigned int i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, (int)i);
+        }
+    }
+
+    // Destructor, runs the tasks still queued
+    ~WorkStealingPool()
+    {
+        while (queued.load() > 0)
+        {
+            this_thread::yield();
+        }
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping.store(true);
+        }
+        wake.notify_all();
+        for (auto& worker : threads)
+        {
+            worker.join();
+        }
+    }
+
+    // Queue a task, tasks queued from a worker stay on that worker until stolen
+    void submit(function<void()> task)
+    {
+        int self = localIndex();
+        size_t index = self >= 0 ? (size_t)self : nextWorker.fetch_add(1) % workers.size();
+        {
+            lock_guard<mutex> lock(workers[index]->tasksMutex);
+            workers[index]->tasks.push_back(move(task));
+        }
+        {
+            // published under sleepMutex, so a worker between its check and wait() cannot miss the wake-up
+            lock_guard<mutex> lock(sleepMutex);
+            queued.fetch_add(1);
+        }
+        wake.notify_one();
+    }
+
+    // Number of worker threads
+    size_t size() const
+    {
+        return workers.size();
+    }
+};
+
+// Fans a notification out over a WorkStealingPool in batches of observers
+// The registry (the item) must outlive the notification: wait on the returned future first.
+class NotificationDispatcher
+{
+    // State shared by the batches of one notification
+    struct FanOut
+    {
+        ItemId itemId;
+        atomic<size_t> pending;
+        promise<void> done;
+
+        // Called once per finished batch, the last one completes the future
+        void finish()
+        {
+            if (pending.fetch_sub(1) == 1)
+            {
+                done.set_value();
+            }
+        }
+    };
+
+    WorkStealingPool& pool;
+    unsigned int batchSize;
+
+    public:
+
+    // Constructor
+    NotificationDispatcher(WorkStealingPool& pool, unsigned int batchSize = 4096) : pool(pool), batchSize(batchSize) {}
+
+    // Notify every observer of the registry, returns at once
+    future<void> dispatch(ObserverRegistry& registry, ItemId itemId)
+    {
+        shared_ptr<FanOut> state = make_shared<FanOut>();
+        state->itemId = itemId;
+        state->pending.store(1);
+        future<void> result = state->done.get_future();
+
+        // Splitting into batches also happens on the pool, so the caller only pays for one submit
+        pool.submit([this, &registry, state]()
+        {
+            for (unsigned int shard = 0; shard < registry.shardCount(); ++shard)
+            {
+                unsigned int slots = registry.slotCount(shard);
+                for (unsigned int begin = 0; begin < slots; begin += batchSize)
+                {
+                    unsigned int end = min(slots, begin + batchSize);
+                    state->pending.fetch_add(1);
+                    pool.submit([&registry, state, shard, begin, end]()
+                    {
+                        registry.forEachInRange(shard, begin, end, [&state](Observer* observer)
+                        {
+                            observer->updateItem(state->itemId);
+                        });
+                        state->finish();
+                    });
+                }
+            }
+            state->finish();
+        });
+        return result;
+    }
+};
+
+// Subject interface
+class Subject
+{
+    public:
+    
+    // Pure virtual function to attach an observer
+    virtual void attach(Observer* observer) = 0;
+    
+    // Pure virtual function to detach an observer
+    virtual void detach(Observer* observer) = 0; 
+    
+    // Pure virtual function to notify observers about an update
+    virtual void notify(const string& itemName) = 0;
+};
+
+// Concrete Subject: AmazonItem
+class AmazonItem : public Subject 
+{
+    private:
+    
+    // Interned name of the Amazon item
+    ItemId itemId; 
+    
+    // Stock status of the item
+    atomic<bool> inStock; 
+    
+    // Registry of observers
+    ObserverRegistry observers; 
+
+    // Handles of observers attached by pointer, so detach(Observer*) stays O(1)
+    mutex handlesMutex;
+    unordered_multimap<Observer*, ObserverHandle> handles;
+
+    public:
+    
+    // Constructor to initialize item name and stock status
+    AmazonItem(const string& name) : itemId(ItemNames::instance().intern(name)), inStock(true) {} 
+
+    // Attach an observer, keep the handle to unsubscribe later
+    ObserverHandle subscribe(Observer* observer)
+    {
+        return observers.attach(observer);
+    }
+
+    // Detach an observer by handle, reclaim as for ObserverRegistry::detach()
+    bool unsubscribe(const ObserverHandle& handle, function<void()> reclaim = nullptr)
+    {
+        return observers.detach(handle, move(reclaim));
+    }
+
+    // Attach an observer to the list
+    void attach(Observer* observer) override
+    {
+        ObserverHandle handle = observers.attach(observer);
+        lock_guard<mutex> lock(handlesMutex);
+        handles.emplace(observer, handle);
+    }
+
+    // Detach an observer from the list
+    void detach(Observer* observer) override
+    {
+        ObserverHandle handle;
+        {
+            lock_guard<mutex> lock(handlesMutex);
+            auto it = handles.find(observer);
+            if (it == handles.end())
+            {
+                return;
+            }
+            handle = it->second;
+            handles.erase(it);
+        }
+        observers.detach(handle);
+    }
+
+    // Notify all observers about the stock status change
+    // This item's own name goes the interned path; any other name is passed on as text, not interned
+    void notify(const string& itemName) override
+    {
+        if (itemName == ItemNames::instance().name(itemId))
+        {
+            notifyItem(itemId);
+            return;
+        }
+        observers.forEach([&itemName](Observer* observer)
+        {
+            observer->update(itemName);
+        });
+    }
+
+    // Notify all observers with the interned id, nothing on this path allocates
+    void notifyItem(ItemId itemId)
+    {
+        observers.forEach([itemId](Observer* observer)
+        {
+            observer->updateItem(itemId);
+        });
+    }
+
+    // Set the stock status and notify observers if the item goes out of stock
+    void setStockStatus(bool status)
+    {
+        if (inStock.exchange(status) != status && !status)
+        {
+            notifyItem(itemId);
+        }
+    }
+
+    // Same, but the notification runs on the dispatcher's pool and this returns at once
+    // The future is ready when every observer has been updated
+    future<void> setStockStatus(bool status, NotificationDispatcher& dispatcher)
+    {
+        if (inStock.exchange(status) != status && !status)
+        {
+            return dispatcher.dispatch(observers, itemId);
+        }
+        promise<void> nothingToDo;
+        nothingToDo.set_value();
+        return nothingToDo.get_future();
+    }
+};
+
+// ******************************* Catalog with inverted subscription index *******************************
+
+// Set of user ids: a sorted array while sparse, a bitmap once that is smaller
+class UserIdSet
+{
+    vector<uint32_t> ids;       // sorted, used while sparse
+    vector<uint64_t> bits;      // used while dense
+    size_t count;
+    bool dense;
+
+    // Switch to the bitmap when it takes less memory than the array
+    void maybeMakeDense()
+    {
+        size_t bitmapBytes = (ids.back() / 64 + 1) * sizeof(uint64_t);
+        if (ids.size() * sizeof(uint32_t) > bitmapBytes)
+        {
+            bits.assign(ids.back() / 64 + 1, 0);
+            for (uint32_t id : ids)
+            {
+                bits[id / 64] |= 1ULL << (id % 64);
+            }
+            vector<uint32_t>().swap(ids);
+            dense = true;
+        }
+    }
+
+    public:
+
+    // Constructor
+    UserIdSet() : count(0), dense(false) {}
+
+    // Add a user id, returns false if it was already there
+    bool insert(uint32_t id)
+    {
+        if (dense)
+        {
+            if (id / 64 >= bits.size())
+            {
+                bits.resize(id / 64 + 1, 0);
+            }
+            uint64_t mask = 1ULL << (id % 64);
+            if (bits[id / 64] & mask)
+            {
+                return false;
+            }
+            bits[id / 64] |= mask;
+            ++count;
+            return true;
+        }
+
+        auto it = lower_bound(ids.begin(), ids.end(), id);
+        if (it != ids.end() && *it == id)
+        {
+            return false;
+        }
+        ids.insert(it, id);
+        ++count;
+        maybeMakeDense();
+        return true;
+    }
+
+    // Remove a user id, returns false if it was not there
+    bool erase(uint32_t id)
+    {
+        if (dense)
+        {
+            uint64_t mask = 1ULL << (id % 64);
+            if (id / 64 >= bits.size() || (bits[id / 64] & mask) == 0)
+            {
+                return false;
+            }
+            bits[id / 64] &= ~mask;
+            --count;
+            return true;
+        }
+
+        auto it = lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id)
+        {
+            return false;
+        }
+        ids.erase(it);
+        --count;
+        return true;
+    }
+
+    // Call function(id) for every id in increasing order
+    template<typename Function>
+    void forEach(Function function) const
+    {
+        if (!dense)
+        {
+            for (uint32_t id : ids)
+            {
+                function(id);
+            }
+            return;
+        }
+        for (size_t word = 0; word < bits.size(); ++word)
+        {
+            for (uint64_t w = bits[word]; w != 0; w &= w - 1)
+            {
+                int bit = 0;
+                while (((w >> bit) & 1) == 0)
+                {
+                    ++bit;
+                }
+                function((uint32_t)(word * 64 + bit));
+            }
+        }
+    }
+
+    // Number of ids
+    size_t size() const
+    {
+        return count;
+    }
+
+    // Bytes used by the ids
+    size_t memoryBytes() const
+    {
+        return ids.capacity() * sizeof(uint32_t) + bits.capacity() * sizeof(uint64_t);
+    }
+};
+
+// One stock change for applyStockUpdates()
+struct StockUpdate
+{
+    uint32_t itemId;
+    bool inStock;
+};
+
+// Subscription service for a whole catalog
+//
+// ---> users and items are registered once and referred to by 32-bit ids, so a user watching
+//      10,000 items costs 10,000 ids in the index instead of 10,000 copies in observer lists.
+// ---> applyStockUpdates() takes a burst of changes, keeps only the final state per item and
+//      notifies each user once with every item that went out of stock.
+// ---> not thread-safe, apply updates from one thread (the inventory sync).
+class SubscriptionCatalog
+{
+    struct Item
+    {
+        ItemId name;
+        bool inStock;
+        UserIdSet watchers;
+    };
+
+    vector<Item> items;
+    vector<Observer*> users;
+
+    // Per-item marks for coalescing a burst, compared against the burst number
+    vector<uint32_t> touchedInBurst;
+    vector<bool> finalStatus;
+    uint32_t burst;
+
+    public:
+
+    // Constructor
+    SubscriptionCatalog() : burst(0) {}
+
+    // Register an item, returns its id
+    uint32_t addItem(const string& name, bool inStock = true)
+    {
+        items.push_back(Item{ ItemNames::instance().intern(name), inStock, UserIdSet() });
+        touchedInBurst.push_back(0);
+        finalStatus.push_back(inStock);
+        return (uint32_t)(items.size() - 1);
+    }
+
+    // Register a user, returns its id
+    uint32_t addUser(Observer* observer)
+    {
+        users.push_back(observer);
+        return (uint32_t)(users.size() - 1);
+    }
+
+    // Start watching an item
+    bool subscribe(uint32_t userId, uint32_t itemId)
+    {
+        return items[itemId].watchers.insert(userId);
+    }
+
+    // Stop watching an item
+    bool unsubscribe(uint32_t userId, uint32_t itemId)
+    {
+        return items[itemId].watchers.erase(userId);
+    }
+
+    // Name of an item
+    string_view itemName(uint32_t itemId) const
+    {
+        return ItemNames::instance().name(items[itemId].name);
+    }
+
+    // Apply a burst of stock changes, returns the number of users notified
+    size_t applyStockUpdates(const StockUpdate* updates, size_t count)
+    {
+        // 1. last update per item wins
+        ++burst;
+        vector<uint32_t> changed;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t itemId = updates[i].itemId;
+            if (touchedInBurst[itemId] != burst)
+            {
+                touchedInBurst[itemId] = burst;
+                changed.push_back(itemId);
+            }
+            finalStatus[itemId] = updates[i].inStock;
+        }
+
+        // 2. items that went out of stock
+        vector<uint32_t> outOfStock;
+        for (uint32_t itemId : changed)
+        {
+            Item& item = items[itemId];
+            bool wasInStock = item.inStock;
+            item.inStock = finalStatus[itemId];
+            if (wasInStock && !item.inStock)
+            {
+                outOfStock.push_back(itemId);
+            }
+        }
+
+        // 3. group the items by user (count, prefix sum, fill) instead of sorting pairs
+        vector<uint32_t> offsets(users.size() + 1, 0);
+        for (uint32_t itemId : outOfStock)
+        {
+            items[itemId].watchers.forEach([&offsets](uint32_t userId)
+            {
+                ++offsets[userId + 1];
+            });
+        }
+        for (size_t u = 0; u < users.size(); ++u)
+        {
+            offsets[u + 1] += offsets[u];
+        }
+        vector<ItemId> namesByUser(offsets.back());
+        vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (uint32_t itemId : outOfStock)
+        {
+            ItemId name = items[itemId].name;
+            items[itemId].watchers.forEach([&namesByUser, &cursor, name](uint32_t userId)
+            {
+                namesByUser[cursor[userId]++] = name;
+            });
+        }
+
+        // 4. one update per user with all of its items
+        size_t notifiedUsers = 0;
+        vector<ItemId> names;
+        for (size_t u = 0; u < users.size(); ++u)
+        {
+            if (offsets[u] == offsets[u + 1])
+            {
+                continue;
+            }
+            names.assign(namesByUser.begin() + offsets[u], namesByUser.begin() + offsets[u + 1]);
+            users[u]->updateBatch(names);
+            ++notifiedUsers;
+        }
+        return notifiedUsers;
+    }
+
+    // Same for a vector of updates
+    size_t applyStockUpdates(const vector<StockUpdate>& updates)
+    {
+        return applyStockUpdates(updates.data(), updates.size());
+    }
+
+    // Bytes used by the inverted index
+    size_t indexMemoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Item& item : items)
+        {
+            bytes += item.watchers.memoryBytes();
+        }
+        return bytes;
+    }
 };
 
-// Subject interface
-class Subject
+// Concrete Observer: User
+class User : public Observer
 {
+    private:
+    // Username of the observer
+    string username; 
+
     public:
-    
-    // Pure virtual function to attach an observer
-    virtual void attach(Observer* observer) = 0;
-    
-    // Pure virtual function to detach an observer
-    virtual void detach(Observer* observer) = 0; 
-    
-    // Pure virtual function to notify observers about an update
-    virtual void notify(const string& itemName) = 0;
+    // Constructor to initialize username
+    User(const string& name) : username(name) {} 
+
+    // Update the user with the item name when the item goes out of stock
+    void update(const string& itemName) override
+    {
+        writeLine(itemName);
+    }
+
+    // Same, straight from the interned name (AmazonItem's path, no std::string for the name)
+    void updateItem(ItemId itemId) override
+    {
+        writeLine(ItemNames::instance().name(itemId));
+    }
+
+    // One write per line, updates may come from several threads
+    // The line is built in a per-thread buffer that keeps its capacity, so it stops allocating once warm
+    void writeLine(string_view itemName)
+    {
+        thread_local string line;
+        line.assign("Dear ").append(username).append(", ").append(itemName).append(" is out of stock on Amazon.\n");
+        cout.write(line.data(), line.size()) << flush;
+    }
+
+    // Update the user once with all items that went out of stock
+    void updateBatch(const vector<ItemId>& itemIds) override
+    {
+        if (itemIds.size() == 1)
+        {
+            updateItem(itemIds[0]);
+            return;
+        }
+        string line = "Dear " + username + ", ";
+        for (size_t i = 0; i < itemIds.size(); ++i)
+        {
+            line += (i == 0 ? "" : (i + 1 == itemIds.size() ? " and " : ", "));
+            line += ItemNames::instance().name(itemIds[i]);
+        }
+        cout << line + " are out of stock on Amazon.\n" << flush;
+    }
 };
 
-// Concrete Subject: AmazonItem
-class AmazonItem : public Subject 
+// Optional layer in front of an observer (itself a decorator around Observer)
+//
+// ---> coalescing: an item that was delivered less than `window` ago is not delivered again, so a
+//      flapping item reaches the user at most once per window (deduplicated per observer and item).
+// ---> rate limiting: a token bucket per observer allows `burst` notifications at once and
+//      `perSecond` on average, the rest is suppressed.
+// ---> the per-item state is created the first time an item is seen, after that no event allocates.
+class ThrottledObserver : public Observer
 {
-    private:
-    
-    // Name of the Amazon item
-    string itemName; 
-    
-    // Stock status of the item
-    bool inStock; 
-    
-    // List of observers
-    vector<Observer*> observers; 
+    Observer* target;
+    chrono::steady_clock::duration window;
+    double perSecond;
+    double burst;
 
-    public:
-    
-    // Constructor to initialize item name and stock status
-    AmazonItem(const string& name) : itemName(name), inStock(true) {} 
+    mutex stateMutex;
+    unordered_map<ItemId, chrono::steady_clock::time_point> lastDelivered;
+    double tokens;
+    chrono::steady_clock::time_point lastRefill;
+    vector<ItemId> batch;
 
-    // Attach an observer to the list
-    void attach(Observer* observer) override
+    // Ids of the names that came in through update(const string&), so each is interned once
+    unordered_map<string, ItemId> namedItems;
+
+    // written under stateMutex, read by the getters from any thread
+    atomic<unsigned long long> delivered;
+    atomic<unsigned long long> coalesced;
+    atomic<unsigned long long> rateLimited;
+
+    // Decide for one item, the caller holds stateMutex
+    bool admit(ItemId itemId, chrono::steady_clock::time_point now)
+    {
+        auto it = lastDelivered.find(itemId);
+        if (it != lastDelivered.end() && now - it->second < window)
+        {
+            coalesced.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        if (tokens < 1.0)
+        {
+            rateLimited.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        tokens -= 1.0;
+        if (it == lastDelivered.end())
+        {
+            lastDelivered.emplace(itemId, now);
+        }
+        else
+        {
+            it->second = now;
+        }
+        delivered.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    // Refill the bucket, the caller holds stateMutex
+    void refill(chrono::steady_clock::time_point now)
     {
-        observers.push_back(observer);
+        tokens = min(burst, tokens + chrono::duration<double>(now - lastRefill).count() * perSecond);
+        lastRefill = now;
     }
 
-    // Detach an observer from the list
-    void detach(Observer* observer) override
+    public:
+
+    // Constructor
+    ThrottledObserver(Observer* target, chrono::steady_clock::duration window, double perSecond, double burst)
+        : target(target), window(window), perSecond(perSecond), burst(burst), tokens(burst),
+          lastRefill(chrono::steady_clock::now()), delivered(0), coalesced(0), rateLimited(0) {}
+
+    // Forward the update unless it is coalesced or rate limited
+    void update(const string& itemName) override
     {
-        for (auto it = observers.begin(); it != observers.end(); ++it)
+        ItemId itemId;
         {
-            if (*it == observer) 
+            lock_guard<mutex> lock(stateMutex);
+            auto it = namedItems.find(itemName);
+            if (it == namedItems.end())
             {
-                observers.erase(it);
-                break;
+                it = namedItems.emplace(itemName, ItemNames::instance().intern(itemName)).first;
             }
+            itemId = it->second;
         }
+        updateItem(itemId);
     }
 
-    // Notify all observers about the stock status change
-    void notify(const string& itemName) override
+    // Same, by interned id
+    void updateItem(ItemId itemId) override
     {
-        for (auto observer : observers)
+        bool deliver;
         {
-            observer->update(itemName);
+            lock_guard<mutex> lock(stateMutex);
+            auto now = chrono::steady_clock::now();
+            refill(now);
+            deliver = admit(itemId, now);
+        }
+        if (deliver)
+        {
+            target->updateItem(itemId);
         }
     }
 
-    // Set the stock status and notify observers if the item goes out of stock
-    void setStockStatus(bool status)
+    // Forward the items that pass, as one batch
+    // The target is called without stateMutex (like updateItem), the batch buffer is lent out meanwhile
+    void updateBatch(const vector<ItemId>& itemIds) override
     {
-        if (inStock != status)
+        vector<ItemId> passing;
         {
-            inStock = status;
-            if (!inStock) 
+            lock_guard<mutex> lock(stateMutex);
+            auto now = chrono::steady_clock::now();
+            refill(now);
+            passing.swap(batch);
+            passing.clear();
+            for (ItemId itemId : itemIds)
             {
-                notify(itemName);
+                if (admit(itemId, now))
+                {
+                    passing.push_back(itemId);
+                }
             }
         }
+        if (!passing.empty())
+        {
+            target->updateBatch(passing);
+        }
+
+        // hand the buffer back so the next batch does not allocate
+        lock_guard<mutex> lock(stateMutex);
+        if (batch.capacity() < passing.capacity())
+        {
+            batch.swap(passing);
+        }
+    }
+
+    // Number of notifications passed to the target
+    unsigned long long getDelivered() const
+    {
+        return delivered.load(memory_order_relaxed);
+    }
+
+    // Number suppressed because the item was delivered within the window
+    unsigned long long getCoalesced() const
+    {
+        return coalesced.load(memory_order_relaxed);
+    }
+
+    // Number suppressed by the token bucket
+    unsigned long long getRateLimited() const
+    {
+        return rateLimited.load(memory_order_relaxed);
     }
 };
 
-// Concrete Observer: User
-class User : public Observer
+#if OBSERVER_COUNT_ALLOCATIONS
+// Global allocation counter, used by the allocation check
+static atomic<unsigned long long> allocationCount(0);
+
+void* operator new(size_t size)
 {
-    private:
-    // Username of the observer
-    string username; 
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+// GCC cannot see that operator new above is malloc based and warns about free() once this is inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+#endif
+
+// Stream buffer that only counts the characters written to it, the allocation check points cout at it
+class CountingStreamBuffer : public streambuf
+{
+    public:
+
+    unsigned long long count = 0;
+
+    protected:
+
+    int overflow(int c) override
+    {
+        ++count;
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char*, streamsize n) override
+    {
+        count += n;
+        return n;
+    }
+};
 
+// Observer that only counts updates, so the benchmark measures the registry and not cout
+class CountingObserver : public Observer
+{
     public:
-    // Constructor to initialize username
-    User(const string& name) : username(name) {} 
 
-    // Update the user with the item name when the item goes out of stock
-    void update(const string& itemName) override
+    // each observer is updated by one batch at a time, so a plain counter is enough
+    unsigned long long updates = 0;
+
+    void update(const string&) override
+    {
+        ++updates;
+    }
+
+    void updateItem(ItemId) override
     {
-        cout << "Dear " << username << ", " << itemName << " is out of stock on Amazon." << endl;
+        ++updates;
     }
 };
 
-int main()
+// Throughput of attach, notify and detach at 1k, 100k and 1M observers
+void runRegistryBenchmark()
+{
+    for (int count : {1000, 100000, 1000000})
+    {
+        AmazonItem item("Smartphone");
+        vector<CountingObserver> users(count);
+        vector<ObserverHandle> handles(count);
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+        {
+            handles[i] = item.subscribe(&users[i]);
+        }
+        auto attached = chrono::steady_clock::now();
+
+        const int rounds = 10;
+        for (int round = 0; round < rounds; ++round)
+        {
+            item.setStockStatus(false);
+            item.setStockStatus(true);
+        }
+        auto notified = chrono::steady_clock::now();
+
+        for (int i = 0; i < count; ++i)
+        {
+            item.unsubscribe(handles[i]);
+        }
+        auto detached = chrono::steady_clock::now();
+
+        auto perSecond = [](double operations, chrono::steady_clock::duration time)
+        {
+            return (long long)(operations / chrono::duration<double>(time).count());
+        };
+        cout << count << " observers: attach " << perSecond(count, attached - start) << "/s, notify "
+             << perSecond((double)count * rounds, notified - attached) << " updates/s, detach "
+             << perSecond(count, detached - notified) << "/s" << endl;
+    }
+}
+
+// End-to-end fan-out latency for 1M observers: serial notify loop vs the dispatcher
+void runFanOutBenchmark()
+{
+    const int count = 1000000;
+    AmazonItem item("Smartphone");
+    vector<CountingObserver> users(count);
+    for (int i = 0; i < count; ++i)
+    {
+        item.subscribe(&users[i]);
+    }
+
+    WorkStealingPool pool;
+    NotificationDispatcher dispatcher(pool);
+
+    const int rounds = 10;
+    chrono::steady_clock::duration serial(0), parallel(0), returned(0);
+    for (int round = 0; round < rounds; ++round)
+    {
+        auto start = chrono::steady_clock::now();
+        item.setStockStatus(false);
+        serial += chrono::steady_clock::now() - start;
+        item.setStockStatus(true);
+
+        start = chrono::steady_clock::now();
+        future<void> done = item.setStockStatus(false, dispatcher);
+        returned += chrono::steady_clock::now() - start;
+        done.get();
+        parallel += chrono::steady_clock::now() - start;
+        item.setStockStatus(true);
+    }
+
+    auto ms = [rounds](chrono::steady_clock::duration time)
+    {
+        return chrono::duration<double, milli>(time).count() / rounds;
+    };
+    cout << count << " observers, " << pool.size() << " pool threads: serial loop " << ms(serial)
+         << " ms, dispatcher " << ms(parallel) << " ms (setStockStatus returned after " << ms(returned) << " ms)" << endl;
+}
+
+// Inventory sync burst: 100k users each watching 100 of 100k items, 50k updates in one burst
+void runCatalogBenchmark()
+{
+    const int userCount = 100000;
+    const int itemCount = 100000;
+    const int watchesPerUser = 100;
+    const int burstSize = 50000;
+
+    SubscriptionCatalog catalog;
+    vector<CountingObserver> users(userCount);
+    for (int i = 0; i < itemCount; ++i)
+    {
+        catalog.addItem("item-" + to_string(i));
+    }
+
+    unsigned int seed = 12345;
+    auto next = [&seed]()
+    {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+
+    auto start = chrono::steady_clock::now();
+    for (int u = 0; u < userCount; ++u)
+    {
+        uint32_t userId = catalog.addUser(&users[u]);
+        for (int w = 0; w < watchesPerUser; ++w)
+        {
+            catalog.subscribe(userId, next() % itemCount);
+        }
+    }
+    auto subscribed = chrono::steady_clock::now();
+
+    // every item in the burst goes out of stock, some flap back in
+    vector<StockUpdate> updates;
+    for (int i = 0; i < burstSize; ++i)
+    {
+        uint32_t itemId = next() % itemCount;
+        updates.push_back(StockUpdate{ itemId, false });
+        if (i % 10 == 0)
+        {
+            updates.push_back(StockUpdate{ itemId, true });
+        }
+    }
+    size_t notified = catalog.applyStockUpdates(updates);
+    auto applied = chrono::steady_clock::now();
+
+    unsigned long long itemUpdates = 0;
+    for (auto& user : users)
+    {
+        itemUpdates += user.updates;
+    }
+
+    cout << "catalog: " << (long long)userCount * watchesPerUser << " subscriptions in "
+         << chrono::duration<double, milli>(subscribed - start).count() << " ms, index "
+         << catalog.indexMemoryBytes() / (1024 * 1024) << " MB (vector<Observer*> per item: "
+         << (long long)userCount * watchesPerUser * sizeof(Observer*) / (1024 * 1024) << " MB)" << endl;
+    cout << "burst of " << updates.size() << " updates: " << chrono::duration<double, milli>(applied - subscribed).count()
+         << " ms, " << notified << " users notified once for " << itemUpdates << " item changes" << endl;
+}
+
+// Flapping item: 10k throttled observers, the item flips 2k times within a short time
+void runThrottleBenchmark()
+{
+    const int observerCount = 10000;
+    const int flaps = 2000;
+
+    AmazonItem item("Smartphone");
+    vector<CountingObserver> users(observerCount);
+    vector<unique_ptr<ThrottledObserver>> throttled;
+    for (int i = 0; i < observerCount; ++i)
+    {
+        throttled.emplace_back(new ThrottledObserver(&users[i], chrono::milliseconds(100), 5.0, 3.0));
+        item.subscribe(throttled.back().get());
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < flaps; ++i)
+    {
+        item.setStockStatus(false);
+        item.setStockStatus(true);
+    }
+    auto end = chrono::steady_clock::now();
+
+    unsigned long long delivered = 0, coalesced = 0, rateLimited = 0;
+    for (auto& observer : throttled)
+    {
+        delivered += observer->getDelivered();
+        coalesced += observer->getCoalesced();
+        rateLimited += observer->getRateLimited();
+    }
+    double events = (double)observerCount * flaps;
+    cout << "flapping: " << (long long)events << " notifications, delivered " << delivered << ", coalesced " << coalesced
+         << ", rate limited " << rateLimited << ", " << chrono::duration<double, nano>(end - start).count() / events
+         << " ns/notification" << endl;
+}
+
+// Allocation check: setStockStatus -> notify -> updateItem must not touch the heap, also for User observers
+// (printing into a counting buffer instead of the console) and a name too long for the small string buffer
+// Returns false on failure
+bool runAllocationCheck()
 {
+#if OBSERVER_COUNT_ALLOCATIONS
+    const string name = "Smartphone with a long product name";
+    AmazonItem item(name);
+    vector<CountingObserver> users(1000);
+    vector<unique_ptr<User>> people;
+    vector<unique_ptr<ThrottledObserver>> throttled;
+    for (auto& user : users)
+    {
+        item.subscribe(&user);
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        people.emplace_back(new User("user" + to_string(i)));
+        item.subscribe(people.back().get());
+        throttled.emplace_back(new ThrottledObserver(&users[i], chrono::milliseconds(1), 1000.0, 10.0));
+        item.subscribe(throttled.back().get());
+    }
+
+    CountingStreamBuffer output;
+    streambuf* console = cout.rdbuf(&output);
+
+    // warm up once, the throttled observers create their per-item state here
+    item.setStockStatus(false);
+    item.setStockStatus(true);
+    item.notify(name);
+
+    unsigned long long before = allocationCount.load();
+    for (int i = 0; i < 1000; ++i)
+    {
+        item.setStockStatus(false);
+        item.setStockStatus(true);
+        item.notify(name);
+    }
+    unsigned long long allocations = allocationCount.load() - before;
+
+    cout.rdbuf(console);
+    bool printed = output.count > 0;
+
+    cout << "allocations for 2000 notifications to 1200 observers: " << allocations
+         << (allocations == 0 && printed ? " (PASS)" : " (FAIL)") << endl;
+    return allocations == 0 && printed;
+#else
+    cout << "allocation counting is off, build with -DOBSERVER_COUNT_ALLOCATIONS=1" << endl;
+    return false;
+#endif
+}
+
+// Detach from inside forEach() on two threads:
+// ---> cross registry: T1 inside r1 detaches from r2 while T2 inside r2 detaches from r1, neither may wait
+//      for the other
+// ---> grace period: T1 detaches an observer from inside r while T2 is still in that observer's update(),
+//      the observer may only be reclaimed after T2 is done with it
+// Returns false on failure (a hang is reported after 10 seconds)
+bool runDetachCheck()
+{
+    auto checks = async(launch::async, []
+    {
+        bool ok = true;
+
+        ObserverRegistry r1;
+        ObserverRegistry r2;
+        CountingObserver a, b;
+        ObserverHandle inR1 = r1.attach(&a);
+        ObserverHandle inR2 = r2.attach(&b);
+        atomic<int> arrived(0);
+        atomic<int> reclaimed(0);
+        auto crossDetach = [&](ObserverRegistry& reading, ObserverRegistry& other, ObserverHandle handle)
+        {
+            reading.forEach([&](Observer*)
+            {
+                arrived.fetch_add(1);
+                while (arrived.load() < 2)
+                {
+                    this_thread::yield();
+                }
+                other.detach(handle, [&] { reclaimed.fetch_add(1); });
+            });
+        };
+        thread t1(crossDetach, ref(r1), ref(r2), inR2);
+        thread t2(crossDetach, ref(r2), ref(r1), inR1);
+        t1.join();
+        t2.join();
+        if (reclaimed.load() != 2)
+        {
+            cout << "FAILED: " << reclaimed.load() << " of 2 cross-registry detaches reclaimed" << endl;
+            ok = false;
+        }
+
+        ObserverRegistry r;
+        CountingObserver detacher, victim;
+        r.attach(&detacher);
+        ObserverHandle victimHandle = r.attach(&victim);
+        atomic<bool> inUpdate(false);
+        atomic<bool> detached(false);
+        atomic<bool> victimReclaimed(false);
+        bool reclaimedTooEarly = false;
+        thread reader([&]
+        {
+            r.forEach([&](Observer* observer)
+            {
+                if (observer != &victim)
+                {
+                    return;
+                }
+                inUpdate.store(true);
+                while (!detached.load())
+                {
+                    this_thread::yield();
+                }
+                this_thread::sleep_for(chrono::milliseconds(50));
+                reclaimedTooEarly = victimReclaimed.load();    // still using the victim here
+            });
+        });
+        while (!inUpdate.load())
+        {
+            this_thread::yield();
+        }
+        r.forEach([&](Observer* observer)
+        {
+            if (observer == &detacher)
+            {
+                r.detach(victimHandle, [&] { victimReclaimed.store(true); });
+                detached.store(true);
+            }
+        });
+        reader.join();
+        if (reclaimedTooEarly || !victimReclaimed.load())
+        {
+            cout << "FAILED: detached observer reclaimed " << (reclaimedTooEarly ? "while another thread used it" : "never")
+                 << endl;
+            ok = false;
+        }
+        return ok;
+    });
+
+    if (checks.wait_for(chrono::seconds(10)) != future_status::ready)
+    {
+        cout << "detach check: FAILED (hung)" << endl;
+        _Exit(1);
+    }
+    bool ok = checks.get();
+    cout << "detach check: " << (ok ? "passed" : "FAILED") << endl;
+    return ok;
+}
+
+// Memory for 10M item names: one std::string per item vs interned ids
+void runInternBenchmark()
+{
+    const int count = 10000000;
+    char buffer[32];
+
+    // bytes requested from the heap: the vector plus every name too long for the small string buffer
+    unsigned long long stringBytes = 0;
+    {
+        vector<string> names;
+        names.reserve(count);
+        for (int i = 0; i < count; ++i)
+        {
+            int length = snprintf(buffer, sizeof(buffer), "Smartphone model %07d", i);
+            names.emplace_back(buffer, length);
+        }
+        size_t inlineCapacity = string().capacity();
+        stringBytes = names.capacity() * sizeof(string);
+        for (const string& name : names)
+        {
+            stringBytes += name.capacity() > inlineCapacity ? name.capacity() + 1 : 0;
+        }
+    }
+
+    size_t tableBefore = ItemNames::instance().memoryBytes();
+    auto start = chrono::steady_clock::now();
+    vector<ItemId> ids;
+    ids.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        int length = snprintf(buffer, sizeof(buffer), "Smartphone model %07d", i);
+        ids.push_back(ItemNames::instance().intern(string_view(buffer, length)));
+    }
+    auto end = chrono::steady_clock::now();
+    size_t internedBytes = ItemNames::instance().memoryBytes() - tableBefore + ids.capacity() * sizeof(ItemId);
+
+    cout << count << " item names: std::string " << stringBytes / (1024 * 1024) << " MB, interned "
+         << internedBytes / (1024 * 1024) << " MB (" << chrono::duration<double, nano>(end - start).count() / count
+         << " ns/intern)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    // ./a.out bench  -> run the registry benchmark instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runRegistryBenchmark();
+        runFanOutBenchmark();
+        runCatalogBenchmark();
+        runThrottleBenchmark();
+        runInternBenchmark();
+        return 0;
+    }
+
+    // ./a.out alloc  -> run the allocation check
+    if (argc > 1 && string(argv[1]) == "alloc")
+    {
+        return runAllocationCheck() ? 0 : 1;
+    }
+
+    // ./a.out check  -> detach from inside notifications on two threads
+    if (argc > 1 && string(argv[1]) == "check")
+    {
+        return runDetachCheck() ? 0 : 1;
+    }
+
     // Create an Amazon item
     AmazonItem item("Smartphone");
 
@@ -125,11 +1929,39 @@ int main()
     // Simulate item going out of stock
     item.setStockStatus(false);
 
+    // Same notification fanned out on a thread pool
+    WorkStealingPool pool(2);
+    NotificationDispatcher dispatcher(pool);
+    item.setStockStatus(true);
+    future<void> notified = item.setStockStatus(false, dispatcher);
+    notified.get();
+
     // Detach a user
     item.detach(&user2);
 
     // Simulate item coming back in stock
     item.setStockStatus(true);
 
+    // Throttled user: the item flaps, Bob hears about it once per second at most
+    AmazonItem flappingItem("Headphones");
+    ThrottledObserver throttledBob(&user2, chrono::seconds(1), 1.0, 1.0);
+    flappingItem.attach(&throttledBob);
+    for (int i = 0; i < 5; ++i)
+    {
+        flappingItem.setStockStatus(false);
+        flappingItem.setStockStatus(true);
+    }
+    cout << "Bob: delivered " << throttledBob.getDelivered() << ", suppressed "
+         << throttledBob.getCoalesced() + throttledBob.getRateLimited() << endl;
+
+    // Catalog: users are notified once per burst with all their items
+    SubscriptionCatalog catalog;
+    uint32_t phone = catalog.addItem("Smartphone");
+    uint32_t laptop = catalog.addItem("Laptop");
+    uint32_t alice = catalog.addUser(&user1);
+    catalog.subscribe(alice, phone);
+    catalog.subscribe(alice, laptop);
+    catalog.applyStockUpdates({ { phone, false }, { laptop, false }, { laptop, true }, { laptop, false } });
+
     return 0;
 }
\ No newline at end of file
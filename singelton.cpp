@@ -97,23 +97,375 @@ static Singleton* createInstance()
         return instance; 
     }
 
+    still racy: the outer check reads instance while another thread writes it, and the pointer can become
+    visible before the object it points to is constructed. The check has to be an atomic load with acquire
+    and the publish an atomic store with release.
+
+Thread-safe singleton:-
+
+    ---> SingletonHolder<T, Policy> gives the one instance of T, created lazily and thread-safe, with one of
+         four policies:
+            Mutex          : lock on every call (Approach 1)
+            MeyersStatic   : function-local static, the compiler adds the guard (C++11 makes it thread-safe)
+            CallOnce       : std::call_once on a once_flag
+            DoubleChecked  : Approach 3 done right, atomic pointer with acquire/release
+    ---> Singleton::createInstance() uses DoubleChecked: as cheap as MeyersStatic after initialization and,
+         unlike it, reset() can destroy the instance (for tests).
+    ---> only that holder is a friend of Singleton, a holder of another policy cannot make a second instance.
+    ---> run "./a.out bench" to measure the per-call cost of every policy from 1 to 64 threads (on a stand-in
+         type, BenchmarkInstance, since every policy's holder keeps its own instance).
+
+Thread-cached access:-
+
+    ---> ThreadCachedSingleton<T, Policy>::get() keeps the instance pointer in a thread_local, tagged with the
+         holder's generation; reset() bumps the generation, so every thread's cache misses once and reloads.
+         A hit is one relaxed load of the generation, no acquire and no guard.
+    ---> stats() counts cache misses over all threads, and calls too when built with -DSINGLETON_COUNT_CALLS=1.
+         Singleton::cachedInstance() uses it.
+    ---> on x86 an acquire load is a plain load, so the cache gains little over DoubleChecked there; it pays
+         where acquire needs a barrier (ARM, POWER) and it never touches the shared line of the pointer.
+
+Tenants:-
+
+    ---> SingletonRegistry<T> holds one instance per key (tenant, NUMA node) in cache-line aligned shards;
+         get(key) is O(1), shutdown() tears the instances down by rank, then in reverse creation order.
+    ---> Singleton::tenantInstance(tenant) uses one; "./a.out bench" also compares a shared instance with
+         packed and padded per-tenant instances under concurrent setdata().
+
+compile:- g++ -std=c++17 -O2 -pthread singelton.cpp
+
 */
 
 #include<iostream>
+#include<string>
+#include<mutex>
+#include<atomic>
+#include<thread>
+#include<vector>
+#include<chrono>
+#include<ctime>
+#include<cstdint>
+#include<algorithm>
+#include<memory>
+#include<new>
 using namespace std;
 
+// How SingletonHolder makes sure the instance is created once
+enum class SingletonPolicy { Mutex, MeyersStatic, CallOnce, DoubleChecked };
+
+// Lazily created, thread-safe single instance of T
+// T keeps its constructor private and declares SingletonHolder a friend
+template<typename T, SingletonPolicy Policy>
+class SingletonHolder
+{
+    // Storage of the Mutex, CallOnce and DoubleChecked policies (unused by MeyersStatic)
+    static inline mutex lock;
+    static inline T* instance = nullptr;
+    static inline once_flag created;
+    static inline atomic<T*> published{ nullptr };
+
+    // Bumped by every reset()
+    static inline atomic<unsigned> generation{ 0 };
+
+    public:
+
+    // Number of reset() calls so far, a pointer got from get() is valid while this does not change
+    static unsigned currentGeneration(memory_order order = memory_order_acquire)
+    {
+        return generation.load(order);
+    }
+
+    // Destroy the instance, the next get() creates a new one (tests, reinitialization)
+    // No other thread may be using the instance meanwhile
+    static void reset()
+    {
+        static_assert(Policy == SingletonPolicy::Mutex || Policy == SingletonPolicy::DoubleChecked,
+                      "a function-local static or a once_flag cannot be reset");
+        lock_guard<mutex> guard(lock);
+        if constexpr (Policy == SingletonPolicy::Mutex)
+        {
+            delete instance;
+            instance = nullptr;
+        }
+        else
+        {
+            delete published.load(memory_order_relaxed);
+            published.store(nullptr, memory_order_release);
+        }
+        generation.fetch_add(1, memory_order_release);
+    }
+
+    // The instance, created by the first call
+    static T* get()
+    {
+        if constexpr (Policy == SingletonPolicy::Mutex)
+        {
+            lock_guard<mutex> guard(lock);
+            if (instance == nullptr)
+            {
+                instance = new T();
+            }
+            return instance;
+        }
+        else if constexpr (Policy == SingletonPolicy::MeyersStatic)
+        {
+            static T object;
+            return &object;
+        }
+        else if constexpr (Policy == SingletonPolicy::CallOnce)
+        {
+            call_once(created, [] { instance = new T(); });
+            return instance;
+        }
+        else
+        {
+            // fast path: one acquire load, pairs with the release store below
+            T* current = published.load(memory_order_acquire);
+            if (current == nullptr)
+            {
+                lock_guard<mutex> guard(lock);
+                current = published.load(memory_order_relaxed);
+                if (current == nullptr)
+                {
+                    current = new T();
+                    published.store(current, memory_order_release);
+                }
+            }
+            return current;
+        }
+    }
+};
+
+// Counting every call costs a load and a store on the hot path, so it is off unless asked for
+#ifndef SINGLETON_COUNT_CALLS
+#define SINGLETON_COUNT_CALLS 0
+#endif
+
+// Calls and cache misses of a ThreadCachedSingleton, over all threads
+struct SingletonCacheStats
+{
+    unsigned long long calls;
+    unsigned long long misses;
+};
+
+// Instance of SingletonHolder<T, Policy> cached per thread
+template<typename T, SingletonPolicy Policy>
+class ThreadCachedSingleton
+{
+    typedef SingletonHolder<T, Policy> Holder;
+
+    // Hot per-thread state, constant-initialized so a thread_local access needs no init guard
+    // The counters are only written by their thread; atomics so stats() may read them
+    struct Cache
+    {
+        T* pointer;
+        unsigned generation;
+        atomic<unsigned long long> calls;
+        atomic<unsigned long long> misses;
+    };
+
+    static Cache& cache()
+    {
+        thread_local Cache perThread{ nullptr, ~0u, { 0 }, { 0 } };
+        return perThread;
+    }
+
+    // Caches of the running threads; a thread's counters move to the retired totals when it exits
+    static inline mutex registryLock;
+    static inline vector<Cache*> live;
+    static inline unsigned long long retiredCalls = 0;
+    static inline unsigned long long retiredMisses = 0;
+
+    struct Registration
+    {
+        Cache* registered;
+
+        Registration() : registered(&cache())
+        {
+            lock_guard<mutex> guard(registryLock);
+            live.push_back(registered);
+        }
+
+        ~Registration()
+        {
+            lock_guard<mutex> guard(registryLock);
+            retiredCalls += registered->calls.load(memory_order_relaxed);
+            retiredMisses += registered->misses.load(memory_order_relaxed);
+            live.erase(find(live.begin(), live.end(), registered));
+        }
+    };
+
+    // Slow path: register the thread (first time), read the generation, then the instance
+    static T* refill(Cache& current)
+    {
+        thread_local Registration registration;
+        current.misses.store(current.misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        current.generation = Holder::currentGeneration();
+        current.pointer = Holder::get();
+        return current.pointer;
+    }
+
+    public:
+
+    // The instance; from the thread's cache unless reset() ran since this thread last looked
+    static T* get()
+    {
+        Cache& current = cache();
+#if SINGLETON_COUNT_CALLS
+        current.calls.store(current.calls.load(memory_order_relaxed) + 1, memory_order_relaxed);
+#endif
+        if (current.generation == Holder::currentGeneration(memory_order_relaxed))
+        {
+            return current.pointer;
+        }
+        return refill(current);
+    }
+
+    // Calls (0 unless built with SINGLETON_COUNT_CALLS=1) and misses so far, over all threads
+    static SingletonCacheStats stats()
+    {
+        lock_guard<mutex> guard(registryLock);
+        SingletonCacheStats total{ retiredCalls, retiredMisses };
+        for (Cache* each : live)
+        {
+            total.calls += each->calls.load(memory_order_relaxed);
+            total.misses += each->misses.load(memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// One instance of T per key (tenant id, NUMA node), keys 0 .. capacity-1
+//
+// ---> every instance lives inside its own shard, aligned to ShardAlign (a cache line by default), so
+//      tenants writing their instances never share a line.
+// ---> get(key) is an index plus an acquire load; the first call for a key creates the instance.
+// ---> shutdown() (also run by the destructor) destroys the instances by ascending teardown rank, equal
+//      ranks in reverse creation order, like static objects. No thread may use them meanwhile.
+template<typename T, size_t ShardAlign = 64>
+class SingletonRegistry
+{
+    // alignas may only raise alignment: a ShardAlign below the members' would be ignored or rejected
+    static_assert(ShardAlign >= alignof(atomic<T*>) && ShardAlign >= alignof(unsigned long long) && ShardAlign >= alignof(T),
+                  "ShardAlign is below the alignment of a shard's members");
+
+    struct alignas(ShardAlign) Shard
+    {
+        atomic<T*> instance{ nullptr };
+        unsigned long long created = 0;     // creation sequence number
+        int teardownRank = 0;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    unique_ptr<Shard[]> shards;
+    size_t capacity;
+    mutex creation;
+    unsigned long long createdSoFar = 0;
+
+    public:
+
+    // Constructor
+    explicit SingletonRegistry(size_t keys) : shards(new Shard[keys]), capacity(keys)
+    {
+    }
+
+    // Instance of a key, nullptr for a key out of range
+    T* get(size_t key)
+    {
+        if (key >= capacity)
+        {
+            return nullptr;
+        }
+        Shard& shard = shards[key];
+        T* current = shard.instance.load(memory_order_acquire);
+        if (current == nullptr)
+        {
+            lock_guard<mutex> guard(creation);
+            current = shard.instance.load(memory_order_relaxed);
+            if (current == nullptr)
+            {
+                current = new (shard.storage) T();
+                shard.created = ++createdSoFar;
+                shard.instance.store(current, memory_order_release);
+            }
+        }
+        return current;
+    }
+
+    // Destroy the key's instance before (lower rank) or after (higher rank) the others, default 0
+    void setTeardownRank(size_t key, int rank)
+    {
+        if (key < capacity)
+        {
+            lock_guard<mutex> guard(creation);
+            shards[key].teardownRank = rank;
+        }
+    }
+
+    // Destroy every instance in teardown order, calling onDestroy(key) just before each
+    template<typename Callback>
+    void shutdown(Callback onDestroy)
+    {
+        lock_guard<mutex> guard(creation);
+        vector<size_t> keys;
+        for (size_t key = 0; key < capacity; ++key)
+        {
+            if (shards[key].instance.load(memory_order_relaxed) != nullptr)
+            {
+                keys.push_back(key);
+            }
+        }
+        sort(keys.begin(), keys.end(), [this](size_t a, size_t b)
+        {
+            if (shards[a].teardownRank != shards[b].teardownRank)
+            {
+                return shards[a].teardownRank < shards[b].teardownRank;
+            }
+            return shards[a].created > shards[b].created;
+        });
+        for (size_t key : keys)
+        {
+            onDestroy(key);
+            shards[key].instance.load(memory_order_relaxed)->~T();
+            shards[key].instance.store(nullptr, memory_order_release);
+        }
+    }
+
+    void shutdown()
+    {
+        shutdown([](size_t) {});
+    }
+
+    // Number of keys
+    size_t size() const
+    {
+        return capacity;
+    }
+
+    // Destructor
+    ~SingletonRegistry()
+    {
+        shutdown();
+    }
+};
+
 // Singleton class definition
 class Singleton
 {
-    // Static pointer to hold the instance of Singleton class
-    static Singleton* instance;
-    
-    // Data member to hold some value
-    int data; 
+    // Only the holder behind createInstance() may create the instance (a holder of another policy would
+    // create a second one); the registry behind tenants() creates the per-tenant instances
+    friend class SingletonHolder<Singleton, SingletonPolicy::DoubleChecked>;
+    friend class SingletonRegistry<Singleton>;
+
+    // Data member to hold some value (atomic: tenants' threads may set it concurrently)
+    atomic<int> data{ 0 };
     
     // Private constructors to prevent instantiation from outside
     // Default constructor
-    Singleton(){} 
+    Singleton()
+    {
+        cout << "Instance created for the first time" << endl;
+    }
     
     // Constructor with parameter
     Singleton(int data) 
@@ -125,38 +477,243 @@ class Singleton
     
     // Static method so that you can call through the name of class as object can't be create
     // Static method to create or get the instance of Singleton class
+    // The holder creates it on the first call, safe when several threads call at once
     static Singleton* createInstance()
     {
-        // Check if instance is not already created
-        if(instance == NULL) 
-        {
-            // Create new instance if not exists
-            instance = new Singleton(); 
-            cout << "Instance created for the first time" << endl;
-        }
-        
-        // Return the instance
-        return instance; 
+        return SingletonHolder<Singleton, SingletonPolicy::DoubleChecked>::get();
+    }
+
+    // Same instance, through the calling thread's cache (for hot loops)
+    static Singleton* cachedInstance()
+    {
+        return ThreadCachedSingleton<Singleton, SingletonPolicy::DoubleChecked>::get();
+    }
+
+    // Destroy the instance, the next call creates a new one (tests); no thread may be using it
+    static void resetInstance()
+    {
+        SingletonHolder<Singleton, SingletonPolicy::DoubleChecked>::reset();
+    }
+
+    // Instances of the tenants, each on its own cache line, torn down when the program ends
+    static SingletonRegistry<Singleton>& tenants()
+    {
+        static SingletonRegistry<Singleton> registry(MAX_TENANTS);
+        return registry;
+    }
+
+    static const size_t MAX_TENANTS = 64;
+
+    // Instance of one tenant (nullptr if tenant >= MAX_TENANTS)
+    static Singleton* tenantInstance(size_t tenant)
+    {
+        return tenants().get(tenant);
     }
 
     // Method to set the data value
     void setdata(int data)
     {
-        this->data = data;
+        this->data.store(data, memory_order_relaxed);
     }
     
     // Method to display the data value
     void showdata()
     {
-        cout << data << " ";
+        cout << data.load(memory_order_relaxed) << " ";
+    }
+};
+
+// CPU time of the calling thread, so time-slicing with more threads than cores is not counted
+double threadSeconds()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Stand-in for Singleton in the policy benchmark: every policy's holder creates its own instance, fine for
+// a type nobody else uses
+class BenchmarkInstance
+{
+    template<typename, SingletonPolicy> friend class SingletonHolder;
+
+    int data = 0;
+
+    BenchmarkInstance() {}
+};
+
+// Every thread calls get() callsPerThread times after the instance exists
+template<typename Getter>
+void runAccessBenchmark(const char* label, Getter get)
+{
+    const int callsPerThread = 1000000;
+    get();
+
+    cout << label << ":";
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        vector<double> busy(threads);
+        vector<uintptr_t> checks(threads);
+        vector<thread> workers;
+        atomic<bool> go{ false };
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                while (!go.load(memory_order_acquire))
+                {
+                    this_thread::yield();
+                }
+                uintptr_t check = 0;
+                double start = threadSeconds();
+                for (int i = 0; i < callsPerThread; ++i)
+                {
+                    check += (uintptr_t)get();
+                }
+                busy[t] = threadSeconds() - start;
+                checks[t] = check;
+            });
+        }
+        go.store(true, memory_order_release);
+        for (thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        double total = 0;
+        bool same = true;
+        for (int t = 0; t < threads; ++t)
+        {
+            total += busy[t];
+            same = same && checks[t] == checks[0];
+        }
+        double ns = total * 1e9 / ((double)threads * callsPerThread);
+        cout << "  " << threads << "T " << ns << " ns" << (same ? "" : " (different instances!)");
+    }
+    cout << endl;
+}
+
+void runBenchmark()
+{
+    cout << "ns per call after initialization (thread CPU time), 1 to 64 threads" << endl;
+    runAccessBenchmark("mutex         ", [] { return SingletonHolder<BenchmarkInstance, SingletonPolicy::Mutex>::get(); });
+    runAccessBenchmark("meyers static ", [] { return SingletonHolder<BenchmarkInstance, SingletonPolicy::MeyersStatic>::get(); });
+    runAccessBenchmark("call_once     ", [] { return SingletonHolder<BenchmarkInstance, SingletonPolicy::CallOnce>::get(); });
+    runAccessBenchmark("double-checked", [] { return SingletonHolder<BenchmarkInstance, SingletonPolicy::DoubleChecked>::get(); });
+    runAccessBenchmark("thread-cached ", [] { return Singleton::cachedInstance(); });
+
+    // a reset invalidates the caches: this thread misses once more, then hits again
+    typedef ThreadCachedSingleton<Singleton, SingletonPolicy::DoubleChecked> Cached;
+    Singleton::cachedInstance();
+    SingletonCacheStats beforeReset = Cached::stats();
+    Singleton::resetInstance();
+    Singleton* after = Singleton::cachedInstance();
+    Singleton::cachedInstance();
+    SingletonCacheStats afterReset = Cached::stats();
+    bool reloaded = after == Singleton::createInstance() && afterReset.misses == beforeReset.misses + 1;
+    cout << "reset: " << (reloaded ? "cache reloaded" : "STALE cache!") << ", misses " << beforeReset.misses << " -> "
+         << afterReset.misses << endl;
+
+    // throughput of the cached accessor on this thread, with the counters
+    const long long calls = 100000000;
+    uintptr_t check = 0;
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < calls; ++i)
+    {
+        check += (uintptr_t)Singleton::cachedInstance();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    SingletonCacheStats total = Cached::stats();
+    cout << "thread-cached: " << (long long)(calls / seconds) << " calls/sec on one thread" << (check ? "" : " ")
+         << ", " << total.misses << " cache misses in all threads";
+    if (SINGLETON_COUNT_CALLS)
+    {
+        cout << ", " << total.calls << " calls counted";
+    }
+    cout << endl;
+}
+
+// Per-tenant data without padding, for the packed baseline: Singleton's data member alone, so 8 tenants
+// share one cache line
+struct PackedTenant
+{
+    atomic<int> data{ 0 };
+
+    void setdata(int value)
+    {
+        data.store(value, memory_order_relaxed);
     }
 };
 
-// Initializing static member of Singleton class
-Singleton* Singleton::instance = NULL;
+// Every thread calls setdata() on its tenant's instance: one shared instance for all, per-tenant data
+// packed next to each other, and per-tenant instances in cache-line shards
+void runTenantBenchmark()
+{
+    const int callsPerThread = 20000000;
+    PackedTenant packed[8];
 
-int main()
+    auto run = [callsPerThread](const char* label, auto instanceOf)
+    {
+        cout << label << ":";
+        for (int threads = 1; threads <= 8; threads *= 2)
+        {
+            vector<double> busy(threads);
+            vector<thread> workers;
+            atomic<bool> go{ false };
+            for (int t = 0; t < threads; ++t)
+            {
+                auto* mine = instanceOf(t);
+                workers.emplace_back([&, t, mine]
+                {
+                    while (!go.load(memory_order_acquire))
+                    {
+                        this_thread::yield();
+                    }
+                    double start = threadSeconds();
+                    for (int i = 0; i < callsPerThread; ++i)
+                    {
+                        mine->setdata(i);
+                    }
+                    busy[t] = threadSeconds() - start;
+                });
+            }
+            go.store(true, memory_order_release);
+            double total = 0;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers[t].join();
+                total += busy[t];
+            }
+            cout << "  " << threads << "T " << total * 1e9 / ((double)threads * callsPerThread) << " ns";
+        }
+        cout << endl;
+    };
+
+    // create the instances first, so their messages do not land in the table
+    for (size_t t = 0; t < 8; ++t)
+    {
+        Singleton::tenantInstance(t);
+    }
+    cout << "ns per setdata (thread CPU time), 1 to 8 threads" << endl;
+    run("one shared instance   ", [](int) { return Singleton::createInstance(); });
+    run("per tenant, packed    ", [&packed](int t) { return &packed[t]; });
+    run("per tenant, own shard ", [](int t) { return Singleton::tenantInstance(t); });
+}
+
+int main(int argc, char* argv[])
 {
+    // ./a.out bench  -> run the benchmark instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runBenchmark();
+        runTenantBenchmark();
+        return 0;
+    }
+
     // Creating instance of Singleton class
     Singleton *obj1 = Singleton::createInstance();
     
@@ -183,6 +740,19 @@ int main()
     obj1->showdata(); 
     
     // both obj1 and obj2 have same data value
+
+    cout << endl;
+
+    // Tenants get an instance each
+    Singleton::tenantInstance(1)->setdata(10);
+    Singleton::tenantInstance(2)->setdata(20);
+    Singleton::tenantInstance(1)->showdata();
+    Singleton::tenantInstance(2)->showdata();
+    cout << endl;
+
+    // Tenant 1 is torn down last, the others in reverse creation order
+    Singleton::tenants().setTeardownRank(1, 1);
+    Singleton::tenants().shutdown([](size_t tenant) { cout << "tearing down tenant " << tenant << endl; });
     
     return 0;
 }
\ No newline at end of file
@@ -1,68 +1,1038 @@
+/*
+Settings store:-
+
+    ---> the settings are read on every frame by many threads, so they live in a SettingsStore (a seqlock):
+         a writer bumps the sequence to odd, writes the fields, bumps it back to even; a reader copies the
+         fields and retries if the sequence was odd or changed meanwhile. Readers never take a lock and
+         never see a half-applied update (e.g. a new width with the old height).
+    ---> setResolution() changes width and height in one update; snapshot() reads all the fields together.
+    ---> run "./a.out bench" to measure reads/sec with 1 writer and N readers, against a mutex.
+
+Configuration file:-
+
+    ---> loadConfig(path) maps the file (mmap) and parses it into a ConfigSnapshot of [section]s with
+         "key = value" lines; the [display] section sets width, height and brightness.
+    ---> reloading hashes every section's text and reparses only the sections whose text changed, the
+         others are shared with the previous snapshot.
+    ---> a new snapshot is published with one pointer swap, readers (ConfigStore::read) take no lock and the
+         old snapshot is freed after every reader that could see it is done (epoch based, like RCU).
+    ---> watchConfig() reloads on change (inotify, Linux only); subscribe(section, callback) is called
+         after a reload changed that section. Replace the file by rename, never rewrite it in place while
+         it is mapped.
+    ---> run "./a.out watch game.cfg" to print the settings whenever game.cfg changes.
+
+compile:- g++ -std=c++17 -O2 -pthread singelton_cppNuts.cpp
+
+*/
+
 #include<iostream>
+#include<string>
+#include<atomic>
+#include<mutex>
+#include<thread>
+#include<vector>
+#include<chrono>
+#include<cstdint>
+#include<cstring>
+#include<cstdio>
+#include<cstdlib>
+#include<string_view>
+#include<memory>
+#include<functional>
+#include<unordered_map>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+#ifdef __linux__
+#include<poll.h>
+#include<sys/inotify.h>
+#endif
 using namespace std;
 
-class gameSetting
+// All the settings, read together
+struct SettingsSnapshot
 {
-    static gameSetting* instance;
     int brightness;
     int width;
     int height;
+};
+
+// Seqlock around the settings: one writer at a time (writers are serialised by a mutex),
+// readers are lock-free and get a consistent copy
+class SettingsStore
+{
+    // Odd while a write is in progress
+    atomic<uint32_t> sequence{ 0 };
+
+    // Fields are atomics (read relaxed) so a reader racing a writer is not undefined behaviour
+    atomic<int> brightness;
+    atomic<int> width;
+    atomic<int> height;
+
+    mutex writers;
+
+    public:
 
     // Constructor
-    gameSetting():width(786), height(1200), brightness(75){}
+    SettingsStore(const SettingsSnapshot& initial)
+        : brightness(initial.brightness), width(initial.width), height(initial.height)
+    {
+    }
+
+    // Consistent copy of all the fields
+    SettingsSnapshot read() const
+    {
+        for (;;)
+        {
+            uint32_t before = sequence.load(memory_order_acquire);
+            if (before & 1)
+            {
+                this_thread::yield();
+                continue;
+            }
+            SettingsSnapshot copy{ brightness.load(memory_order_relaxed), width.load(memory_order_relaxed),
+                                   height.load(memory_order_relaxed) };
+            // the field loads may not move below the second sequence load
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence.load(memory_order_relaxed) == before)
+            {
+                return copy;
+            }
+        }
+    }
+
+    // Apply change(SettingsSnapshot&) to the current values and publish the result as one update
+    template<typename Change>
+    void update(Change change)
+    {
+        lock_guard<mutex> guard(writers);
+        SettingsSnapshot next{ brightness.load(memory_order_relaxed), width.load(memory_order_relaxed),
+                               height.load(memory_order_relaxed) };
+        change(next);
+
+        uint32_t current = sequence.load(memory_order_relaxed);
+        sequence.store(current + 1, memory_order_relaxed);
+        // the field stores may not move above the odd sequence
+        atomic_thread_fence(memory_order_release);
+        brightness.store(next.brightness, memory_order_relaxed);
+        width.store(next.width, memory_order_relaxed);
+        height.store(next.height, memory_order_relaxed);
+        sequence.store(current + 2, memory_order_release);
+    }
+
+    // Number of updates published so far
+    uint32_t version() const
+    {
+        return sequence.load(memory_order_acquire) / 2;
+    }
+};
+
+// One [section] of a configuration file, parsed
+struct ConfigSection
+{
+    string name;
+
+    // Hash and size of the section's text: equal text is not parsed again on reload
+    uint64_t textHash = 0;
+    size_t textSize = 0;
+
+    // key/value pairs sorted by key, the last one wins for repeated keys
+    vector<pair<string, string>> values;
+
+    // Value of a key, nullptr when missing
+    const string* find(string_view key) const
+    {
+        auto it = lower_bound(values.begin(), values.end(), key,
+                              [](const pair<string, string>& entry, string_view wanted) { return entry.first < wanted; });
+        return it != values.end() && it->first == key ? &it->second : nullptr;
+    }
+};
+
+// Whole configuration at one version, never changed once published
+struct ConfigSnapshot
+{
+    uint64_t version = 0;
+
+    // Sections in file order; unchanged ones are shared with the previous snapshot
+    vector<shared_ptr<const ConfigSection>> sections;
+
+    // Index in sections by name (the last one for repeated names)
+    unordered_map<string_view, size_t> byName;
+
+    const shared_ptr<const ConfigSection>* sharedSection(string_view name) const
+    {
+        auto it = byName.find(name);
+        return it != byName.end() ? &sections[it->second] : nullptr;
+    }
+
+    const ConfigSection* section(string_view name) const
+    {
+        const shared_ptr<const ConfigSection>* found = sharedSection(name);
+        return found ? found->get() : nullptr;
+    }
+
+    // Value of section.key, nullptr when missing
+    const string* value(string_view sectionName, string_view key) const
+    {
+        const ConfigSection* found = section(sectionName);
+        return found ? found->find(key) : nullptr;
+    }
+};
+
+// What the last reload did
+struct ConfigReloadStats
+{
+    size_t bytes = 0;
+    size_t sections = 0;
+    size_t reparsed = 0;
+    double microseconds = 0;
+};
+
+// Read-only view of a whole file, mapped where the platform allows it
+class MappedConfigFile
+{
+    const char* data = nullptr;
+    size_t length = 0;
+    string copy;        // contents when the file could not be mapped
+    bool mapped = false;
 
     public:
-    static gameSetting* getInstance()
+
+    // Map (or read) the file, false if it cannot be opened
+    bool open(const string& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        bool empty = fstat(fd, &info) == 0 && info.st_size == 0;
+        if (!empty)
+        {
+            void* memory = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory != MAP_FAILED)
+            {
+                data = (const char*)memory;
+                length = (size_t)info.st_size;
+                mapped = true;
+            }
+        }
+        ::close(fd);
+        if (mapped || empty)
+        {
+            return true;
+        }
+#endif
+        ifstream file(path, ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        stringstream contents;
+        contents << file.rdbuf();
+        copy = contents.str();
+        data = copy.data();
+        length = copy.size();
+        return true;
+    }
+
+    string_view text() const
+    {
+        return string_view(data, length);
+    }
+
+    // Destructor
+    ~MappedConfigFile()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped)
+        {
+            munmap((void*)data, length);
+        }
+#endif
+    }
+};
+
+// Configuration loaded from a file, published as immutable snapshots
+//
+// ---> read(f) calls f(snapshot) without locks, the snapshot stays valid until f returns.
+// ---> reload() builds the next snapshot, swaps it in, waits for the readers of the old one (two-counter
+//      epoch, like RCU), frees it and calls the subscribers of the sections that changed.
+// ---> callbacks run on the reloading thread after its locks are released, so they may subscribe,
+//      unsubscribe or call lastReload(); they must not call reload() themselves (it would wait for them).
+class ConfigStore
+{
+    atomic<const ConfigSnapshot*> current;
+
+    // Epoch based grace period for freeing old snapshots
+    mutable atomic<unsigned long long> epoch{ 0 };
+    mutable atomic<long> readers[2];
+
+    // One reload at a time
+    mutex reloadMutex;
+    string path;
+
+    // What the last reload did, apart from reloadMutex so callbacks can ask
+    mutex statsMutex;
+    ConfigReloadStats stats;
+
+    struct Subscription
+    {
+        int id;
+        string section;
+        function<void(const ConfigSnapshot&)> callback;
+    };
+    mutex subscriptionMutex;
+    vector<Subscription> subscriptions;
+    int nextSubscription = 1;
+
+    // File watching
+    thread watcher;
+    atomic<bool> stopWatching{ false };
+
+    // Hash of a section's text, 8 bytes per step
+    static uint64_t hashText(string_view text)
+    {
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ text.size();
+        size_t i = 0;
+        for (; i + 8 <= text.size(); i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, text.data() + i, 8);
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        for (; i < text.size(); ++i)
+        {
+            hash = (hash ^ (unsigned char)text[i]) * 0x100000001B3ull;
+        }
+        return hash ^ (hash >> 29);
+    }
+
+    static string_view trim(string_view text)
+    {
+        size_t first = 0;
+        size_t last = text.size();
+        while (first < last && (text[first] == ' ' || text[first] == '\t' || text[first] == '\r'))
+        {
+            ++first;
+        }
+        while (last > first && (text[last - 1] == ' ' || text[last - 1] == '\t' || text[last - 1] == '\r'))
+        {
+            --last;
+        }
+        return text.substr(first, last - first);
+    }
+
+    // Parse the "key = value" lines of a section body
+    static shared_ptr<const ConfigSection> parseSection(string_view name, string_view body, uint64_t hash)
+    {
+        auto section = make_shared<ConfigSection>();
+        section->name = string(name);
+        section->textHash = hash;
+        section->textSize = body.size();
+        size_t position = 0;
+        while (position < body.size())
+        {
+            size_t end = body.find('\n', position);
+            if (end == string_view::npos)
+            {
+                end = body.size();
+            }
+            string_view line = trim(body.substr(position, end - position));
+            position = end + 1;
+            if (line.empty() || line[0] == '#' || line[0] == ';')
+            {
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == string_view::npos)
+            {
+                continue;
+            }
+            section->values.emplace_back(string(trim(line.substr(0, equals))), string(trim(line.substr(equals + 1))));
+        }
+
+        // sort by key, keep the last of repeated keys
+        auto& values = section->values;
+        stable_sort(values.begin(), values.end(),
+                    [](const pair<string, string>& a, const pair<string, string>& b) { return a.first < b.first; });
+        size_t kept = 0;
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (i + 1 < values.size() && values[i + 1].first == values[i].first)
+            {
+                continue;
+            }
+            if (kept != i)
+            {
+                values[kept] = move(values[i]);
+            }
+            ++kept;
+        }
+        values.resize(kept);
+        return section;
+    }
+
+    // Split the text into sections, reparsing only those that differ from the previous snapshot
+    static ConfigSnapshot* build(string_view text, const ConfigSnapshot* previous, size_t& reparsed)
+    {
+        ConfigSnapshot* next = new ConfigSnapshot();
+        next->version = previous ? previous->version + 1 : 1;
+        reparsed = 0;
+
+        auto finish = [&](string_view name, string_view body)
+        {
+            uint64_t hash = hashText(body);
+            const shared_ptr<const ConfigSection>* old = previous ? previous->sharedSection(name) : nullptr;
+            if (old && (*old)->textHash == hash && (*old)->textSize == body.size())
+            {
+                next->sections.push_back(*old);
+                return;
+            }
+            next->sections.push_back(parseSection(name, body, hash));
+            ++reparsed;
+        };
+
+        string_view name;
+        size_t bodyStart = 0;
+        size_t position = 0;
+        while (position < text.size())
+        {
+            const char* newline = (const char*)memchr(text.data() + position, '\n', text.size() - position);
+            size_t end = newline ? (size_t)(newline - text.data()) : text.size();
+            string_view line = trim(text.substr(position, end - position));
+            if (!line.empty() && line[0] == '[' && line.back() == ']')
+            {
+                if (position > bodyStart || !name.empty())
+                {
+                    finish(name, text.substr(bodyStart, position - bodyStart));
+                }
+                name = trim(line.substr(1, line.size() - 2));
+                bodyStart = end + 1 < text.size() ? end + 1 : text.size();
+            }
+            position = end + 1;
+        }
+        if (text.size() > bodyStart || !name.empty())
+        {
+            finish(name, text.substr(bodyStart));
+        }
+
+        next->byName.reserve(next->sections.size());
+        for (size_t i = 0; i < next->sections.size(); ++i)
+        {
+            next->byName[next->sections[i]->name] = i;
+        }
+        return next;
+    }
+
+    // Start a read section, returns the counter to release
+    int enterRead() const
+    {
+        for (;;)
+        {
+            unsigned long long now = epoch.load();
+            int parity = (int)(now & 1);
+            readers[parity].fetch_add(1);
+            if (epoch.load() == now)
+            {
+                return parity;
+            }
+            readers[parity].fetch_sub(1);
+        }
+    }
+
+    // Wait until every read() that started before this call has ended
+    void synchronize()
+    {
+        for (int phase = 0; phase < 2; ++phase)
+        {
+            unsigned long long previous = epoch.fetch_add(1);
+            while (readers[previous & 1].load() != 0)
+            {
+                this_thread::yield();
+            }
+        }
+    }
+
+    public:
+
+    // Constructor, starts with an empty snapshot
+    ConfigStore() : current(new ConfigSnapshot())
+    {
+        readers[0].store(0);
+        readers[1].store(0);
+    }
+
+    // Call f(const ConfigSnapshot&) on the current snapshot, lock-free
+    template<typename Reader>
+    auto read(Reader reader) const
+    {
+        // leaves the read section when reader() returns (or throws)
+        struct Exit
+        {
+            atomic<long>& counter;
+            ~Exit() { counter.fetch_sub(1); }
+        } exit{ readers[enterRead()] };
+        return reader(*current.load(memory_order_acquire));
+    }
+
+    // Version of the current snapshot (0 before the first load)
+    uint64_t version() const
+    {
+        return read([](const ConfigSnapshot& snapshot) { return snapshot.version; });
+    }
+
+    // Remember the file and load it
+    bool load(const string& file)
+    {
+        {
+            lock_guard<mutex> guard(reloadMutex);
+            path = file;
+        }
+        return reload();
+    }
+
+    // Load the file again and publish a new snapshot, false (old snapshot kept) if it cannot be read
+    bool reload()
+    {
+        unique_lock<mutex> guard(reloadMutex);
+        auto start = chrono::steady_clock::now();
+        MappedConfigFile file;
+        if (path.empty() || !file.open(path))
+        {
+            return false;
+        }
+
+        const ConfigSnapshot* previous = current.load(memory_order_relaxed);
+        size_t reparsed = 0;
+        ConfigSnapshot* next = build(file.text(), previous, reparsed);
+
+        // sections that are new or changed, and sections that are gone
+        vector<string_view> changed;
+        for (const auto& section : next->sections)
+        {
+            if (previous->section(section->name) != section.get() && next->section(section->name) == section.get())
+            {
+                changed.push_back(section->name);
+            }
+        }
+        vector<string> removed;
+        for (const auto& section : previous->sections)
+        {
+            if (!next->section(section->name) && previous->section(section->name) == section.get())
+            {
+                removed.push_back(section->name);
+            }
+        }
+
+        current.store(next, memory_order_release);
+        synchronize();
+        delete previous;
+
+        {
+            lock_guard<mutex> statsGuard(statsMutex);
+            stats.bytes = file.text().size();
+            stats.sections = next->sections.size();
+            stats.reparsed = reparsed;
+            stats.microseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        }
+
+        // copy the callbacks to run, they are called without any lock held
+        vector<function<void(const ConfigSnapshot&)>> callbacks;
+        {
+            lock_guard<mutex> subscribers(subscriptionMutex);
+            for (const Subscription& subscription : subscriptions)
+            {
+                bool hit = find(changed.begin(), changed.end(), subscription.section) != changed.end() ||
+                           find(removed.begin(), removed.end(), subscription.section) != removed.end();
+                if (hit)
+                {
+                    callbacks.push_back(subscription.callback);
+                }
+            }
+        }
+        if (callbacks.empty())
+        {
+            return true;
+        }
+
+        // a read section keeps next alive for the callbacks: a later reload frees it only after they return
+        int parity = enterRead();
+        guard.unlock();
+        for (const auto& callback : callbacks)
+        {
+            callback(*next);
+        }
+        readers[parity].fetch_sub(1);
+        return true;
+    }
+
+    // What the last reload did
+    ConfigReloadStats lastReload()
+    {
+        lock_guard<mutex> guard(statsMutex);
+        return stats;
+    }
+
+    // Call callback(snapshot) after every reload that changed (added, modified or removed) the section
+    int subscribe(const string& section, function<void(const ConfigSnapshot&)> callback)
+    {
+        lock_guard<mutex> guard(subscriptionMutex);
+        subscriptions.push_back(Subscription{ nextSubscription, section, move(callback) });
+        return nextSubscription++;
+    }
+
+    void unsubscribe(int id)
+    {
+        lock_guard<mutex> guard(subscriptionMutex);
+        subscriptions.erase(remove_if(subscriptions.begin(), subscriptions.end(),
+                                      [id](const Subscription& subscription) { return subscription.id == id; }),
+                            subscriptions.end());
+    }
+
+    // Reload whenever the loaded file is written or replaced, false where inotify is not available
+    bool watch()
+    {
+#ifdef __linux__
+        string file;
+        {
+            lock_guard<mutex> guard(reloadMutex);
+            file = path;
+        }
+        if (file.empty() || watcher.joinable())
+        {
+            return false;
+        }
+        // watch the directory: editors and deploy scripts replace the file by rename
+        size_t slash = file.rfind('/');
+        string directory = slash == string::npos ? "." : file.substr(0, slash + 1);
+        string name = slash == string::npos ? file : file.substr(slash + 1);
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        stopWatching.store(false);
+        watcher = thread([this, fd, name]
+        {
+            alignas(inotify_event) char buffer[4096];
+            while (!stopWatching.load())
+            {
+                pollfd ready{ fd, POLLIN, 0 };
+                if (poll(&ready, 1, 50) <= 0)
+                {
+                    continue;
+                }
+                bool ours = false;
+                ssize_t length;
+                while ((length = ::read(fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (ssize_t offset = 0; offset < length;)
+                    {
+                        const inotify_event* event = (const inotify_event*)(buffer + offset);
+                        ours = ours || (event->len > 0 && name == event->name);
+                        offset += sizeof(inotify_event) + event->len;
+                    }
+                }
+                if (ours)
+                {
+                    reload();
+                }
+            }
+            ::close(fd);
+        });
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Stop the watcher thread
+    void unwatch()
     {
-        if(instance==NULL)
+        if (watcher.joinable())
         {
-            instance= new gameSetting();
-            return instance;
+            stopWatching.store(true);
+            watcher.join();
         }
     }
 
+    // Destructor
+    ~ConfigStore()
+    {
+        unwatch();
+        delete current.load();
+    }
+};
+
+class gameSetting
+{
+    SettingsStore settings;
+    ConfigStore configuration;
+
+    // Constructor, the [display] section of the configuration overrides the defaults
+    gameSetting():settings(SettingsSnapshot{ 75, 786, 1200 })
+    {
+        configuration.subscribe("display", [this](const ConfigSnapshot& snapshot) { applyDisplay(snapshot); });
+    }
+
+    // Publish width, height and brightness of the [display] section as one update
+    void applyDisplay(const ConfigSnapshot& snapshot)
+    {
+        const ConfigSection* display = snapshot.section("display");
+        if (!display)
+        {
+            return;
+        }
+        settings.update([display](SettingsSnapshot& next)
+        {
+            if (const string* value = display->find("width"))
+            {
+                next.width = atoi(value->c_str());
+            }
+            if (const string* value = display->find("height"))
+            {
+                next.height = atoi(value->c_str());
+            }
+            if (const string* value = display->find("brightness"))
+            {
+                next.brightness = atoi(value->c_str());
+            }
+        });
+    }
+
+    public:
+    // Created on the first call (thread-safe function-local static), destroyed at exit
+    static gameSetting* getInstance()
+    {
+        static gameSetting instance;
+        return &instance;
+    }
+
     void setWidth(int width)
     {
-        this->width=width;
+        settings.update([width](SettingsSnapshot& next) { next.width = width; });
     }
 
     void setHeight(int height)
     {
-        this->height=height;
+        settings.update([height](SettingsSnapshot& next) { next.height = height; });
+    }
+
+    // Width and height together, readers see both or neither
+    void setResolution(int width, int height)
+    {
+        settings.update([width, height](SettingsSnapshot& next)
+        {
+            next.width = width;
+            next.height = height;
+        });
     }
 
     void setBrightness(int brightness)
     {
-        this->brightness=brightness;
+        settings.update([brightness](SettingsSnapshot& next) { next.brightness = brightness; });
     }
 
     int getWidth()
     {
-        return this->width;
+        return settings.read().width;
     }
 
     int getHeight()
     {
-        return this->height;
+        return settings.read().height;
     }
 
     int getBrightness()
     {
-        return this->brightness;
+        return settings.read().brightness;
+    }
+
+    // All the settings at one point in time
+    SettingsSnapshot snapshot()
+    {
+        return settings.read();
+    }
+
+    // Load the settings from a configuration file
+    bool loadConfig(const string& path)
+    {
+        return configuration.load(path);
+    }
+
+    // Reload the configuration whenever its file changes
+    bool watchConfig()
+    {
+        return configuration.watch();
+    }
+
+    // The whole configuration, for sections other than [display]
+    ConfigStore& config()
+    {
+        return configuration;
     }
 
     void displaySetting()
     {
-        cout<<"Brightness: "<<brightness<<endl;
-        cout<<"Height: "<<height<<endl;
-        cout<<"Width: "<<width<<endl;
+        SettingsSnapshot current = settings.read();
+        cout<<"Brightness: "<<current.brightness<<endl;
+        cout<<"Height: "<<current.height<<endl;
+        cout<<"Width: "<<current.width<<endl;
     }
 };
 
-gameSetting* gameSetting::instance=NULL;
+// Same interface as SettingsStore with a mutex, the baseline of the benchmark
+class LockedSettings
+{
+    mutable mutex lock;
+    SettingsSnapshot values;
 
-int main()
+    public:
+
+    LockedSettings(const SettingsSnapshot& initial) : values(initial)
+    {
+    }
+
+    SettingsSnapshot read() const
+    {
+        lock_guard<mutex> guard(lock);
+        return values;
+    }
+
+    template<typename Change>
+    void update(Change change)
+    {
+        lock_guard<mutex> guard(lock);
+        change(values);
+    }
+};
+
+// 1 writer flipping between two complete settings, N readers taking snapshots for a fixed time
+// A snapshot mixing the two settings is torn; there must be none
+template<typename Store>
+void runStoreBenchmark(const char* label)
+{
+    const SettingsSnapshot first{ 75, 786, 1200 };
+    const SettingsSnapshot second{ 100, 1920, 1080 };
+    const chrono::milliseconds duration(300);
+
+    cout << label << ":";
+    for (int readers = 1; readers <= 8; readers *= 2)
+    {
+        Store store(first);
+        atomic<bool> stop{ false };
+        vector<long long> reads(readers);
+        vector<long long> torn(readers);
+        vector<thread> threads;
+
+        thread writer([&]
+        {
+            bool flip = false;
+            while (!stop.load(memory_order_relaxed))
+            {
+                const SettingsSnapshot& target = flip ? first : second;
+                store.update([&target](SettingsSnapshot& next) { next = target; });
+                flip = !flip;
+            }
+        });
+        for (int r = 0; r < readers; ++r)
+        {
+            threads.emplace_back([&, r]
+            {
+                long long count = 0;
+                long long mixed = 0;
+                while (!stop.load(memory_order_relaxed))
+                {
+                    SettingsSnapshot current = store.read();
+                    bool isFirst = current.width == first.width && current.height == first.height &&
+                                   current.brightness == first.brightness;
+                    bool isSecond = current.width == second.width && current.height == second.height &&
+                                    current.brightness == second.brightness;
+                    mixed += !isFirst && !isSecond;
+                    ++count;
+                }
+                reads[r] = count;
+                torn[r] = mixed;
+            });
+        }
+
+        this_thread::sleep_for(duration);
+        stop.store(true);
+        writer.join();
+        long long totalReads = 0;
+        long long totalTorn = 0;
+        for (int r = 0; r < readers; ++r)
+        {
+            threads[r].join();
+            totalReads += reads[r];
+            totalTorn += torn[r];
+        }
+        cout << "  " << readers << "R " << (long long)(totalReads / chrono::duration<double>(duration).count())
+             << " reads/sec" << (totalTorn == 0 ? "" : " (" + to_string(totalTorn) + " torn!)");
+    }
+    cout << endl;
+}
+
+// Write a configuration file the safe way: to a temporary file, then rename over the old one
+bool writeConfig(const string& path, const string& contents)
 {
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        if (!file.write(contents.data(), (streamsize)contents.size()))
+        {
+            return false;
+        }
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// Reload of a 10 MB configuration: first load, reload of an unchanged file, reload with one section changed,
+// and the time from replacing the file to the subscriber's callback (inotify)
+void runReloadBenchmark()
+{
+    const string path = "reload_bench.cfg";
+    const int sectionCount = 23000;
+    const int keysPerSection = 20;
+
+    vector<string> sections;
+    sections.push_back("[display]\nwidth = 786\nheight = 1200\nbrightness = 75\n");
+    for (int s = 0; s < sectionCount; ++s)
+    {
+        string text = "[section" + to_string(s) + "]\n";
+        for (int k = 0; k < keysPerSection; ++k)
+        {
+            text += "key" + to_string(k) + " = value_" + to_string(s) + "_" + to_string(k) + "\n";
+        }
+        sections.push_back(text);
+    }
+    auto contents = [&sections]
+    {
+        string all;
+        for (const string& text : sections)
+        {
+            all += text;
+        }
+        return all;
+    };
+    if (!writeConfig(path, contents()))
+    {
+        cout << "cannot write " << path << endl;
+        return;
+    }
+
+    ConfigStore store;
+    auto report = [&store](const char* label)
+    {
+        ConfigReloadStats stats = store.lastReload();
+        cout << label << stats.microseconds / 1000 << " ms, " << stats.bytes / 1024 << " KB, " << stats.reparsed << " of "
+             << stats.sections << " sections parsed" << endl;
+    };
+    store.load(path);
+    report("first load:        ");
+    store.reload();
+    report("reload, unchanged: ");
+
+    // one value of one section changes
+    const int changedSection = 1 + sectionCount / 2;
+    sections[changedSection].replace(sections[changedSection].find("value_"), 6, "VALUE_");
+    writeConfig(path, contents());
+    store.reload();
+    report("reload, 1 changed: ");
+
+    // file replaced -> inotify -> reload -> callback
+    atomic<long long> notifiedAt{ 0 };
+    store.subscribe("section" + to_string(changedSection - 1), [&notifiedAt](const ConfigSnapshot&)
+    {
+        notifiedAt.store(chrono::steady_clock::now().time_since_epoch().count());
+    });
+    if (store.watch())
+    {
+        const int rounds = 5;
+        double total = 0;
+        int seen = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            string& text = sections[changedSection];
+            size_t at = text.find("ALUE_");
+            text[at - 1] = text[at - 1] == 'V' ? 'v' : 'V';
+            string all = contents();
+            notifiedAt.store(0);
+            writeConfig(path, all);
+            auto replaced = chrono::steady_clock::now();
+            while (notifiedAt.load() == 0 && chrono::steady_clock::now() - replaced < chrono::seconds(5))
+            {
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+            if (notifiedAt.load() != 0)
+            {
+                total += (notifiedAt.load() - replaced.time_since_epoch().count()) / 1e6;
+                ++seen;
+            }
+        }
+        store.unwatch();
+        cout << "file replaced -> callback: " << (seen ? total / seen : 0) << " ms average, " << seen << " of " << rounds
+             << " changes seen" << endl;
+    }
+    else
+    {
+        cout << "file watching not available here" << endl;
+    }
+    remove(path.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    // ./a.out bench  -> run the benchmark instead of the demo
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        runStoreBenchmark<SettingsStore>("seqlock");
+        runStoreBenchmark<LockedSettings>("mutex  ");
+        runReloadBenchmark();
+        return 0;
+    }
+
+    // ./a.out watch game.cfg  -> load the settings from game.cfg and print them whenever it changes
+    if (argc > 2 && string(argv[1]) == "watch")
+    {
+        gameSetting *setting = gameSetting::getInstance();
+        if (!setting->loadConfig(argv[2]))
+        {
+            cout << "cannot read " << argv[2] << endl;
+            return 1;
+        }
+        setting->displaySetting();
+        setting->config().subscribe("display", [setting](const ConfigSnapshot& snapshot)
+        {
+            cout << "version " << snapshot.version << endl;
+            setting->displaySetting();
+        });
+        if (!setting->watchConfig())
+        {
+            cout << "file watching not available here" << endl;
+            return 1;
+        }
+        cout << "watching " << argv[2] << ", press Enter to stop" << endl;
+        cin.get();
+        setting->config().unwatch();
+        return 0;
+    }
+
     gameSetting *setting = gameSetting::getInstance();
     setting->displaySetting();
     setting->setBrightness(400);
@@ -71,4 +1041,4 @@ int main()
     setting->displaySetting();
 
     return 0;
-}
\ No newline at end of file
+}